@@ -0,0 +1,186 @@
+/*
+ *  Copyright (C) 2010 Andrew Wilson.
+ *  All rights reserved.
+ *  Contact email: amwgeo@gmail.com
+ *
+ *  This file is part of xmlMine-Vent
+ *
+ *  xmlMine-Vent is free software: you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation, either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  xmlMine-Vent is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General
+ *  Public License along with xmlMine-Vent.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "minegenerator.h"
+
+#include "xmVent-lib/network.h"
+
+#include <QBuffer>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLoggingCategory>
+#include <QStringList>
+#include <QTextStream>
+
+
+/// solver method by name, -1 if unknown
+static int xmVentBenchMethod( const QString& name )
+{
+    if( name == "HardyCross" ) {
+        return XMVentSolveHC::HardyCross;
+    } else if( name == "NewtonRaphson" ) {
+        return XMVentSolveHC::NewtonRaphson;
+    } else if( name == "JunctionPressure" ) {
+        return XMVentSolveHC::JunctionPressure;
+    }
+    return -1;
+}
+
+
+/// Generates mine networks of increasing size and times reading, meshing,
+/// flow initialisation and iteration of each solver method.  The results are
+/// written as a JSON array with one record per network, method and run.
+int main( int argc, char *argv[] )
+{
+    QCoreApplication a( argc, argv );
+    a.setApplicationName( "xmVent-bench" );
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription( "Ventilation solver benchmark on synthetic mine networks" );
+    parser.addHelpOption();
+    QCommandLineOption branchesOption( "branches", "Comma separated network sizes.", "list",
+                                       "100,1000,10000,100000" );
+    QCommandLineOption methodOption( "method", "Comma separated solver methods.", "list",
+                                     "HardyCross,NewtonRaphson,JunctionPressure" );
+    QCommandLineOption toleranceOption( "tolerance", "Mesh correction tolerance.", "value", "0.5" );
+    QCommandLineOption iterationOption( "max-iterations", "Iteration limit.", "count", "10000" );
+    QCommandLineOption repeatOption( "repeat", "Runs of every network and method.", "count", "1" );
+    QCommandLineOption seedOption( "seed", "Random seed of the generated resistances.", "value", "1" );
+    QCommandLineOption outputOption( "output", "Write the results to file instead of stdout.", "file" );
+    QCommandLineOption writeOption( "write", "Save each generated network as <prefix><branches>.xml.", "prefix" );
+    QCommandLineOption verboseOption( "verbose", "Log every run and the solver progress to stderr." );
+    parser.addOption( branchesOption );
+    parser.addOption( methodOption );
+    parser.addOption( toleranceOption );
+    parser.addOption( iterationOption );
+    parser.addOption( repeatOption );
+    parser.addOption( seedOption );
+    parser.addOption( outputOption );
+    parser.addOption( writeOption );
+    parser.addOption( verboseOption );
+    parser.process( a );
+
+    // errors are still reported
+    const bool verbose = parser.isSet( verboseOption );
+    if( !verbose ) {
+        QLoggingCategory::setFilterRules( QStringLiteral( "xmvent.debug=false" ) );
+    }
+
+    const QStringList sizeList = parser.value( branchesOption ).split( ',', QString::SkipEmptyParts );
+    const QStringList methodList = parser.value( methodOption ).split( ',', QString::SkipEmptyParts );
+    const float tolerance = parser.value( toleranceOption ).toFloat();
+    const int iterationMax = parser.value( iterationOption ).toInt();
+    const int repeat = qMax( 1, parser.value( repeatOption ).toInt() );
+    for( int m = 0; m < methodList.count(); m++ ) {
+        if( xmVentBenchMethod( methodList[m] ) < 0 ) {
+            qCritical() << "Unknown solver method" << methodList[m];
+            return 1;
+        }
+    }
+
+    QJsonArray results;
+    for( int s = 0; s < sizeList.count(); s++ ) {
+        XMVentMineGenerator generator;
+        generator.seed = parser.value( seedOption ).toUInt();
+        generator.setBranchCount( sizeList[s].toInt() );
+
+        QByteArray xml;
+        QBuffer xmlBuffer( &xml );
+        xmlBuffer.open( QIODevice::WriteOnly );
+        generator.write( &xmlBuffer );
+        xmlBuffer.close();
+
+        if( parser.isSet( writeOption ) ) {
+            QFile file( parser.value( writeOption ) + QString::number( generator.branchCount() ) + ".xml" );
+            if( file.open( QIODevice::WriteOnly ) ) {
+                file.write( xml );
+            }
+        }
+
+        for( int m = 0; m < methodList.count(); m++ ) {
+            for( int run = 0; run < repeat; run++ ) {
+                XMVentNetwork net;
+                net.m_solver.setMethod( XMVentSolveHC::Method( xmVentBenchMethod( methodList[m] ) ) );
+
+                QElapsedTimer timer;
+                timer.start();
+                QBuffer source( &xml );
+                source.open( QIODevice::ReadOnly );
+                net.fromXml( &source );
+                const double parseTime = timer.nsecsElapsed() * 1e-6;
+
+                net.m_solver.initialize();
+                net.m_solver.solve( tolerance, iterationMax );
+
+                const XMVentSolveHCStatistics& statistics = net.m_solver.statistics();
+                QJsonObject record;
+                record.insert( "branches", net.m_branch.count() );
+                record.insert( "junctions", net.m_junction.count() );
+                record.insert( "meshes", generator.meshCount() );
+                record.insert( "levels", generator.levels );
+                record.insert( "crosscuts", generator.crosscuts );
+                record.insert( "fixedFlows", net.m_fixedFlow.count() );
+                record.insert( "method", methodList[m] );
+                record.insert( "run", run );
+                record.insert( "iterations", statistics.iterations );
+                record.insert( "converged", statistics.converged );
+                record.insert( "residual", statistics.residual );
+                record.insert( "imbalance", statistics.imbalance );
+
+                QJsonObject time;
+                time.insert( "parse", parseTime );
+                time.insert( "graph", statistics.graphTime );
+                time.insert( "createMesh", statistics.meshTime );
+                time.insert( "flowInitialize", statistics.flowInitializeTime );
+                time.insert( "iteration", statistics.iterationTime );
+                record.insert( "time", time );
+                results.append( record );
+
+                if( verbose ) {
+                    qDebug() << methodList[m] << net.m_branch.count() << "branches:" << statistics.iterations
+                             << "iterations in" << statistics.iterationTime << "ms";
+                }
+            }
+        }
+    }
+
+    const QByteArray json = QJsonDocument( results ).toJson();
+    if( parser.isSet( outputOption ) ) {
+        QFile file( parser.value( outputOption ) );
+        if( !file.open( QIODevice::WriteOnly ) ) {
+            qCritical() << "Cannot write" << parser.value( outputOption );
+            return 1;
+        }
+        file.write( json );
+    } else {
+        QTextStream( stdout ) << json;
+    }
+
+    return 0;
+}
@@ -0,0 +1,203 @@
+/*
+ *  Copyright (C) 2010 Andrew Wilson.
+ *  All rights reserved.
+ *  Contact email: amwgeo@gmail.com
+ *
+ *  This file is part of xmlMine-Vent
+ *
+ *  xmlMine-Vent is free software: you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation, either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  xmlMine-Vent is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General
+ *  Public License along with xmlMine-Vent.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "minegenerator.h"
+
+#include <QIODevice>
+#include <QXmlStreamWriter>
+
+#include <cmath>
+
+
+XMVentMineGenerator::XMVentMineGenerator()
+{
+    levels = 4;
+    crosscuts = 10;
+    levelSpacing = 60.f;
+    crosscutSpacing = 50.f;
+    workplaceInterval = 4;
+    workplaceFlow = 15.f;
+    boosterInterval = 5;
+    seed = 1;
+    m_random = seed;
+}
+
+
+/// choose levels and crosscuts for about the given number of branches: the
+/// mine gets deeper as well as longer, roughly sqrt(branches) / 4 levels
+void XMVentMineGenerator::setBranchCount( int branches )
+{
+    levels = qBound( 2, int( std::sqrt( double( branches ) ) / 4. + 0.5 ), 400 );
+    crosscuts = qMax( 1, ( ( branches - 1 ) / levels - 5 ) / 3 );
+}
+
+
+int XMVentMineGenerator::branchCount() const
+{
+    return levels * ( 3 * crosscuts + 5 ) + 1;
+}
+
+
+int XMVentMineGenerator::junctionCount() const
+{
+    return levels * ( 2 * crosscuts + 3 ) + 4;
+}
+
+
+/// independent meshes, the three surface junctions being one atmosphere node
+int XMVentMineGenerator::meshCount() const
+{
+    return branchCount() - junctionCount() + 3;
+}
+
+
+int XMVentMineGenerator::workplaceCount() const
+{
+    int n = 0;
+    if( workplaceInterval > 0 ) {
+        for( int i = 0; i <= crosscuts; i++ ) {
+            n += ( i % workplaceInterval == workplaceInterval / 2 );
+        }
+    }
+    return n * levels;
+}
+
+
+/// deterministic uniform random number in [low, high)
+float XMVentMineGenerator::uniform( float low, float high ) const
+{
+    m_random = m_random * 1664525u + 1013904223u;
+    return low + ( high - low ) * float( m_random >> 8 ) / float( 1 << 24 );
+}
+
+
+void XMVentMineGenerator::writeJunction( QXmlStreamWriter& xml, const QString& id, float x, float y, float z,
+                                         bool surface ) const
+{
+    xml.writeEmptyElement( "junction" );
+    xml.writeAttribute( "id", id );
+    xml.writeAttribute( "x", QString::number( x ) );
+    xml.writeAttribute( "y", QString::number( y ) );
+    xml.writeAttribute( "z", QString::number( z ) );
+    if( surface ) {
+        xml.writeAttribute( "surface", "true" );
+    }
+}
+
+
+void XMVentMineGenerator::writeBranch( QXmlStreamWriter& xml, const QString& id, const QString& from,
+                                       const QString& to, float resistance, const QString& fan, float flow ) const
+{
+    xml.writeEmptyElement( "branch" );
+    xml.writeAttribute( "id", id );
+    xml.writeAttribute( "from", from );
+    xml.writeAttribute( "to", to );
+    xml.writeAttribute( "resistance", QString::number( resistance ) );
+    if( !fan.isEmpty() ) {
+        xml.writeAttribute( "fan", "#" + fan );
+    }
+    if( flow != 0.f ) {
+        xml.writeAttribute( "flow", QString::number( flow ) );
+    }
+}
+
+
+void XMVentMineGenerator::write( QIODevice* dev ) const
+{
+    m_random = seed;
+    const float length = ( crosscuts + 1 ) * crosscutSpacing;
+    const float orebody = 100.f;        // m from the footwall drive to the orebody drive
+
+    QXmlStreamWriter xml( dev );
+    xml.setAutoFormatting( true );
+    xml.writeStartDocument();
+    xml.writeStartElement( "ventNetwork" );
+    xml.writeDefaultNamespace( "http://xmlmine.org/xml/ventilation/" );
+    xml.writeAttribute( "version", "0.1" );
+    xml.writeTextElement( "title", QString( "Synthetic mine, %1 levels of %2 crosscuts" ).arg( levels ).arg( crosscuts ) );
+
+    xml.writeStartElement( "fanList" );
+    xml.writeEmptyElement( "fan" );
+    xml.writeAttribute( "id", "main_fan" );
+    xml.writeAttribute( "pressure", QString::number( 1500.f + 25.f * levels ) );
+    if( boosterInterval > 0 ) {
+        xml.writeEmptyElement( "fan" );
+        xml.writeAttribute( "id", "booster_fan" );
+        xml.writeAttribute( "pressure", "300" );
+    }
+    xml.writeEndElement();
+
+    // shaft collars and the ramp portal are on surface; levels go down from there
+    xml.writeStartElement( "junctionList" );
+    writeJunction( xml, "intake", 0.f, 0.f, 0.f, true );
+    writeJunction( xml, "portal", -200.f, orebody, 0.f, true );
+    writeJunction( xml, "exhaust", length, orebody, 0.f );
+    writeJunction( xml, "fan", length, orebody, 10.f, true );
+    for( int k = 0; k < levels; k++ ) {
+        const float z = -levelSpacing * ( k + 1 );
+        for( int i = 0; i <= crosscuts; i++ ) {
+            writeJunction( xml, QString( "L%1D%2" ).arg( k ).arg( i ), i * crosscutSpacing, 0.f, z );
+            writeJunction( xml, QString( "L%1O%2" ).arg( k ).arg( i ), i * crosscutSpacing, orebody, z );
+        }
+        writeJunction( xml, QString( "L%1X" ).arg( k ), length, orebody, z );
+    }
+    xml.writeEndElement();
+
+    xml.writeStartElement( "branchList" );
+    writeBranch( xml, "main_fan", "exhaust", "fan", 0.01f, "main_fan" );
+    for( int k = 0; k < levels; k++ ) {
+        const QString level = QString( "L%1" ).arg( k );
+        const QString above = ( k == 0 ? QString() : QString( "L%1" ).arg( k - 1 ) );
+
+        // shafts and ramp down from the level above
+        writeBranch( xml, level + "is", k == 0 ? QString( "intake" ) : above + "D0", level + "D0",
+                     levelSpacing * uniform( 3e-5f, 5e-5f ) );
+        writeBranch( xml, level + "es", level + "X", k == 0 ? QString( "exhaust" ) : above + "X",
+                     levelSpacing * uniform( 4e-5f, 6e-5f ) );
+        writeBranch( xml, level + "ramp", k == 0 ? QString( "portal" ) : above + "O0", level + "O0",
+                     uniform( 0.2f, 0.4f ) );
+
+        // drives and crosscuts; workplaces are fixed flow crosscuts
+        for( int i = 0; i <= crosscuts; i++ ) {
+            const QString n = QString::number( i );
+            const QString next = QString::number( i + 1 );
+            if( i < crosscuts ) {
+                writeBranch( xml, level + "d" + n, level + "D" + n, level + "D" + next, uniform( 0.01f, 0.03f ) );
+                writeBranch( xml, level + "o" + n, level + "O" + n, level + "O" + next, uniform( 0.02f, 0.05f ) );
+            }
+            const bool workplace = ( workplaceInterval > 0 && i % workplaceInterval == workplaceInterval / 2 );
+            writeBranch( xml, level + "c" + n, level + "D" + n, level + "O" + n,
+                         workplace ? uniform( 0.5f, 2.f ) : uniform( 0.05f, 0.2f ), QString(),
+                         workplace ? workplaceFlow : 0.f );
+        }
+
+        // level return to the exhaust shaft
+        const bool booster = ( boosterInterval > 0 && k % boosterInterval == boosterInterval - 1 );
+        writeBranch( xml, level + "r", level + "O" + QString::number( crosscuts ), level + "X",
+                     uniform( 0.05f, 0.1f ), booster ? QString( "booster_fan" ) : QString() );
+    }
+    xml.writeEndElement();
+
+    xml.writeEndElement();
+    xml.writeEndDocument();
+}
@@ -0,0 +1,76 @@
+/*
+ *  Copyright (C) 2010 Andrew Wilson.
+ *  All rights reserved.
+ *  Contact email: amwgeo@gmail.com
+ *
+ *  This file is part of xmlMine-Vent
+ *
+ *  xmlMine-Vent is free software: you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation, either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  xmlMine-Vent is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General
+ *  Public License along with xmlMine-Vent.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef XMVENTMINEGENERATOR_H
+#define XMVENTMINEGENERATOR_H
+
+#include <QtGlobal>
+#include <QString>
+
+class QIODevice;
+class QXmlStreamWriter;
+
+
+/// Writes a synthetic underground mine as a ventilation network XML file.
+/// Air enters by an intake shaft and a ramp portal and leaves by an exhaust
+/// shaft with the main fan at its collar.  On each level a footwall drive
+/// runs from the intake shaft station, crosscuts lead from it to an orebody
+/// drive, and the orebody drive returns to the exhaust shaft.  The ramp joins
+/// the orebody drives of neighbouring levels.  Some crosscuts are workplaces
+/// with a fixed flow, and some levels have a booster fan on their return.
+/// A level has 3 * crosscuts + 5 branches.  The same parameters always give
+/// the same network.
+class XMVentMineGenerator
+{
+public:
+    int levels;
+    int crosscuts;                  // per level
+    float levelSpacing;             // m between levels
+    float crosscutSpacing;          // m between crosscuts along the drives
+    int workplaceInterval;          // every n-th crosscut has a fixed flow, 0 for none
+    float workplaceFlow;            // m3/s
+    int boosterInterval;            // every n-th level has a booster fan, 0 for none
+    quint32 seed;
+
+    XMVentMineGenerator();
+
+    void setBranchCount( int branches );
+    int branchCount() const;
+    int junctionCount() const;
+    int workplaceCount() const;
+    int meshCount() const;
+
+    void write( QIODevice* dev ) const;
+
+protected:
+    mutable quint32 m_random;
+
+    float uniform( float low, float high ) const;
+    void writeJunction( QXmlStreamWriter& xml, const QString& id, float x, float y, float z,
+                        bool surface = false ) const;
+    void writeBranch( QXmlStreamWriter& xml, const QString& id, const QString& from, const QString& to,
+                      float resistance, const QString& fan = QString(), float flow = 0.f ) const;
+};
+
+
+#endif // XMVENTMINEGENERATOR_H
@@ -0,0 +1,42 @@
+#
+#  Copyright (C) 2010 Andrew Wilson.
+#  All rights reserved.
+#  Contact email: amwgeo@gmail.com
+#
+#  This file is part of xmlMine-Vent
+#
+#  xmlMine-Vent is free software: you can redistribute it and/or
+#  modify it under the terms of the GNU Lesser General Public
+#  License as published by the Free Software Foundation, either
+#  version 3 of the License, or (at your option) any later version.
+#
+#  xmlMine-Vent is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU Lesser General Public License for more details.
+#
+#  You should have received a copy of the GNU Lesser General
+#  Public License along with xmlMine-Vent.  If not, see
+#  <http://www.gnu.org/licenses/>.
+#
+
+
+QT       += core gui
+
+TARGET = xmVent-bench
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+DESTDIR = ../build
+
+win32 {
+    LIBS += -L../build -lxmVent1
+} else {
+    LIBS += -L../build -lxmVent
+}
+
+INCLUDEPATH += ..   # provides access to "xmVent-lib/..."
+
+HEADERS += minegenerator.h
+
+SOURCES += main.cpp minegenerator.cpp
@@ -0,0 +1,328 @@
+/*
+ *  Copyright (C) 2010 Andrew Wilson.
+ *  All rights reserved.
+ *  Contact email: amwgeo@gmail.com
+ *
+ *  This file is part of xmlMine-Vent
+ *
+ *  xmlMine-Vent is free software: you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation, either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  xmlMine-Vent is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General
+ *  Public License along with xmlMine-Vent.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "xmVent-lib/network.h"
+#include "xmVent-lib/branch.h"
+#include "xmVent-lib/junction.h"
+
+#include <QAtomicInt>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLoggingCategory>
+#include <QRunnable>
+#include <QStringList>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
+
+
+/// solver settings shared by all files
+struct XMVentCliSettings {
+    XMVentSolveHC::Method method;
+    float tolerance;
+    int iterationMax;
+    QString binaryDirectory;    // where to save each network as .xmvb, empty for nowhere
+};
+
+
+/// one worker thread: loads and solves the next unsolved file until none are left
+class XMVentCliTask : public QRunnable
+{
+protected:
+    const QStringList& m_file;
+    QVariantMap* m_result;
+    QAtomicInt& m_next;
+    const XMVentCliSettings& m_settings;
+
+    void solve( const QString& fileName, QVariantMap& result )
+    {
+        result.insert( "file", fileName );
+
+        XMVentNetwork net;
+        net.m_solver.setThreadCount( 1 );
+        net.m_solver.setMethod( m_settings.method );
+        if( fileName.endsWith( ".xmvb", Qt::CaseInsensitive ) ) {
+            net.fromBinary( fileName );
+        } else {
+            net.fromXml( fileName );
+        }
+        if( net.m_branch.isEmpty() ) {
+            result.insert( "error", "no branches read" );
+            return;
+        }
+
+        net.m_solver.initialize();
+        net.m_solver.solve( m_settings.tolerance, m_settings.iterationMax );
+
+        // with the meshes just found, for a fast reload
+        if( !m_settings.binaryDirectory.isEmpty() ) {
+            const QString binaryName = QFileInfo( fileName ).completeBaseName() + ".xmvb";
+            if( !net.toBinary( QDir( m_settings.binaryDirectory ).filePath( binaryName ) ) ) {
+                result.insert( "error", "cannot save " + binaryName );
+            }
+        }
+
+        // fixed flow pressures are in fixed flow branch order
+        const QVariantList fixedFlowPressure = net.m_solver.fixedFlowPressure();
+        QVariantList branchList;
+        int f = 0;
+        for( int b = 0; b < net.m_branch.count(); b++ ) {
+            QVariantMap r;
+            r.insert( "id", net.m_branch.id[b] );
+            r.insert( "from", net.m_junction.id[ net.m_branch.from[b] ] );
+            r.insert( "to", net.m_junction.id[ net.m_branch.to[b] ] );
+            r.insert( "flow", net.m_solver.m_flowList.value( b ) );
+            if( net.m_fixedFlow.contains( b ) && f < fixedFlowPressure.count() ) {
+                r.insert( "fixedFlowPressure", fixedFlowPressure[ f++ ] );
+            }
+            branchList.append( r );
+        }
+        result.insert( "branches", branchList );
+        result.insert( "statistics", net.m_solver.getStatistics() );
+    }
+
+public:
+    XMVentCliTask( const QStringList& file, QVariantMap* result, QAtomicInt& next,
+                   const XMVentCliSettings& settings ) :
+        m_file( file ), m_result( result ), m_next( next ), m_settings( settings ) {}
+
+    void run()
+    {
+        for( ;; ) {
+            const int i = m_next.fetchAndAddOrdered( 1 );
+            if( i >= m_file.count() ) {
+                break;
+            }
+            solve( m_file[i], m_result[i] );
+        }
+    }
+};
+
+
+/// quote a CSV field if it needs it
+static QString xmVentCsv( const QString& field )
+{
+    if( !field.contains( ',' ) && !field.contains( '"' ) && !field.contains( '\n' ) ) {
+        return field;
+    }
+    QString quoted( field );
+    quoted.replace( "\"", "\"\"" );
+    return "\"" + quoted + "\"";
+}
+
+
+/// one row per branch: file,branch,from,to,flow,fixedFlowPressure
+static void xmVentWriteFlowCsv( QTextStream& out, const QVector<QVariantMap>& result )
+{
+    out << "file,branch,from,to,flow,fixedFlowPressure\n";
+    for( int i = 0; i < result.count(); i++ ) {
+        const QString file = xmVentCsv( result[i].value( "file" ).toString() );
+        const QVariantList branchList = result[i].value( "branches" ).toList();
+        for( int b = 0; b < branchList.count(); b++ ) {
+            const QVariantMap branch = branchList[b].toMap();
+            out << file << ","
+                << xmVentCsv( branch.value( "id" ).toString() ) << ","
+                << xmVentCsv( branch.value( "from" ).toString() ) << ","
+                << xmVentCsv( branch.value( "to" ).toString() ) << ","
+                << QString::number( branch.value( "flow" ).toDouble(), 'g', 8 ) << ",";
+            if( branch.contains( "fixedFlowPressure" ) ) {
+                out << QString::number( branch.value( "fixedFlowPressure" ).toDouble(), 'g', 8 );
+            }
+            out << "\n";
+        }
+    }
+}
+
+
+/// one row per file with the solver statistics
+static void xmVentWriteStatisticsCsv( QTextStream& out, const QVector<QVariantMap>& result )
+{
+    out << "file,error,method,converged,iterations,residual,imbalance,graph,createMesh,flowInitialize,iteration\n";
+    for( int i = 0; i < result.count(); i++ ) {
+        const QVariantMap statistics = result[i].value( "statistics" ).toMap();
+        const QVariantMap time = statistics.value( "time" ).toMap();
+        out << xmVentCsv( result[i].value( "file" ).toString() ) << ","
+            << xmVentCsv( result[i].value( "error" ).toString() ) << ","
+            << statistics.value( "method" ).toString() << ","
+            << ( statistics.value( "converged" ).toBool() ? "true" : "false" ) << ","
+            << statistics.value( "iterations" ).toInt() << ","
+            << statistics.value( "residual" ).toDouble() << ","
+            << statistics.value( "imbalance" ).toDouble() << ","
+            << time.value( "graph" ).toDouble() << ","
+            << time.value( "createMesh" ).toDouble() << ","
+            << time.value( "flowInitialize" ).toDouble() << ","
+            << time.value( "iteration" ).toDouble() << "\n";
+    }
+}
+
+
+/// write to fileName, or stdout if it is empty
+static bool xmVentWrite( const QString& fileName, const QString& format, const QVector<QVariantMap>& result,
+                         bool statisticsOnly )
+{
+    QFile file;
+    if( fileName.isEmpty() ) {
+        if( !file.open( stdout, QIODevice::WriteOnly ) ) {
+            return false;
+        }
+    } else {
+        file.setFileName( fileName );
+        if( !file.open( QIODevice::WriteOnly ) ) {
+            qCritical() << "Cannot write" << fileName;
+            return false;
+        }
+    }
+
+    if( format == "json" ) {
+        QVariantList list;
+        for( int i = 0; i < result.count(); i++ ) {
+            list.append( result[i] );
+        }
+        QVariantMap document;
+        document.insert( "networks", list );
+        file.write( QJsonDocument( QJsonObject::fromVariantMap( document ) ).toJson() );
+    } else {
+        QTextStream out( &file );
+        if( statisticsOnly ) {
+            xmVentWriteStatisticsCsv( out, result );
+        } else {
+            xmVentWriteFlowCsv( out, result );
+        }
+    }
+    return true;
+}
+
+
+/// Solves ventilation network files without the GUI.  Every file is solved
+/// on its own network and solver, several files at a time.
+int main( int argc, char *argv[] )
+{
+    QCoreApplication a( argc, argv );
+    a.setApplicationName( "xmVent-cli" );
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription( "Solve ventilation network XML files" );
+    parser.addHelpOption();
+    parser.addPositionalArgument( "networks", "Network XML or .xmvb files, or directories of them.",
+                                  "<file|directory>..." );
+    QCommandLineOption formatOption( "format", "Output format, csv or json.", "format", "json" );
+    QCommandLineOption outputOption( "output", "Write the results to file instead of stdout.", "file" );
+    QCommandLineOption statisticsOption( "statistics", "Write the solver statistics as CSV to file.", "file" );
+    QCommandLineOption methodOption( "method", "HardyCross, NewtonRaphson or JunctionPressure.", "method",
+                                     "HardyCross" );
+    QCommandLineOption toleranceOption( "tolerance", "Mesh correction tolerance.", "value", "0.5" );
+    QCommandLineOption iterationOption( "max-iterations", "Iteration limit.", "count", "1000000" );
+    QCommandLineOption binaryOption( "save-binary", "Also save every network with its meshes as .xmvb in directory.",
+                                     "directory" );
+    QCommandLineOption threadOption( "threads", "Files solved at a time, 0 for one per core.", "count", "0" );
+    QCommandLineOption verboseOption( "verbose", "Log the progress of loading and solving to stderr." );
+    parser.addOption( formatOption );
+    parser.addOption( outputOption );
+    parser.addOption( statisticsOption );
+    parser.addOption( methodOption );
+    parser.addOption( toleranceOption );
+    parser.addOption( iterationOption );
+    parser.addOption( binaryOption );
+    parser.addOption( threadOption );
+    parser.addOption( verboseOption );
+    parser.process( a );
+
+    // errors are still reported
+    if( !parser.isSet( verboseOption ) ) {
+        QLoggingCategory::setFilterRules( QStringLiteral( "xmvent.debug=false" ) );
+    }
+
+    XMVentCliSettings settings;
+    const QString method = parser.value( methodOption );
+    if( method == "HardyCross" ) {
+        settings.method = XMVentSolveHC::HardyCross;
+    } else if( method == "NewtonRaphson" ) {
+        settings.method = XMVentSolveHC::NewtonRaphson;
+    } else if( method == "JunctionPressure" ) {
+        settings.method = XMVentSolveHC::JunctionPressure;
+    } else {
+        qCritical() << "Unknown solver method" << method;
+        return 1;
+    }
+    settings.tolerance = parser.value( toleranceOption ).toFloat();
+    settings.iterationMax = parser.value( iterationOption ).toInt();
+    settings.binaryDirectory = parser.value( binaryOption );
+
+    const QString format = parser.value( formatOption );
+    if( format != "csv" && format != "json" ) {
+        qCritical() << "Unknown output format" << format;
+        return 1;
+    }
+
+    // directories stand for the network files in them
+    QStringList fileList;
+    const QStringList argument = parser.positionalArguments();
+    for( int i = 0; i < argument.count(); i++ ) {
+        if( QFileInfo( argument[i] ).isDir() ) {
+            QDir dir( argument[i] );
+            const QStringList entry = dir.entryList( QStringList() << "*.xml" << "*.xmvb", QDir::Files, QDir::Name );
+            for( int k = 0; k < entry.count(); k++ ) {
+                fileList.append( dir.filePath( entry[k] ) );
+            }
+        } else {
+            fileList.append( argument[i] );
+        }
+    }
+    if( fileList.isEmpty() ) {
+        parser.showHelp( 1 );
+    }
+
+    const int threadCount = parser.value( threadOption ).toInt();
+    const int nThreads = qMin( threadCount > 0 ? threadCount : QThread::idealThreadCount(), fileList.count() );
+    QVector<QVariantMap> result( fileList.count() );
+    QAtomicInt next( 0 );
+    QThreadPool pool;
+    pool.setMaxThreadCount( qMax( nThreads, 1 ) );
+    for( int t = 0; t < nThreads; t++ ) {
+        pool.start( new XMVentCliTask( fileList, result.data(), next, settings ) );
+    }
+    pool.waitForDone();
+
+    if( !xmVentWrite( parser.value( outputOption ), format, result, false ) ) {
+        return 1;
+    }
+    if( parser.isSet( statisticsOption ) && !xmVentWrite( parser.value( statisticsOption ), "csv", result, true ) ) {
+        return 1;
+    }
+
+    // failed to read or to converge
+    for( int i = 0; i < result.count(); i++ ) {
+        if( !result[i].value( "statistics" ).toMap().value( "converged" ).toBool() ) {
+            qWarning() << "Not solved:" << result[i].value( "file" ).toString();
+            return 2;
+        }
+    }
+    return 0;
+}
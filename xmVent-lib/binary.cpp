@@ -0,0 +1,325 @@
+/*
+ *  Copyright (C) 2010 Andrew Wilson.
+ *  All rights reserved.
+ *  Contact email: amwgeo@gmail.com
+ *
+ *  This file is part of xmlMine-Vent
+ *
+ *  xmlMine-Vent is free software: you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation, either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  xmlMine-Vent is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General
+ *  Public License along with xmlMine-Vent.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "binary.h"
+
+#include "network.h"
+#include "junction.h"
+#include "branch.h"
+#include "fan.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QHash>
+#include <QSaveFile>
+#include <QVector>
+
+#include <cstring>
+
+
+/// round up to the 8 byte section alignment
+static quint64 xmVentBinaryAlign( quint64 offset )
+{
+    return ( offset + 7 ) & ~quint64( 7 );
+}
+
+
+/// string table under construction: every distinct string once
+class XMVentBinaryStrings
+{
+protected:
+    QHash<QString, quint32> m_index;
+
+public:
+    QVector<quint32> offset;
+    QByteArray data;
+
+    XMVentBinaryStrings()
+    {
+        offset.append( 0 );
+    }
+
+    quint32 intern( const QString& s )
+    {
+        if( s.isNull() ) {
+            return xmVentBinaryNoString;
+        }
+        QHash<QString, quint32>::const_iterator it = m_index.constFind( s );
+        if( it != m_index.constEnd() ) {
+            return it.value();
+        }
+        const quint32 i = offset.count() - 1;
+        data.append( s.toUtf8() );
+        offset.append( data.size() );
+        m_index.insert( s, i );
+        return i;
+    }
+};
+
+
+/// write the network, with the meshes of the last XMVentSolveHC::initialize()
+/// if withMesh, to a binary file for fromBinary()
+bool XMVentNetwork::toBinary( const QString& filename, bool withMesh ) const
+{
+    XMVentBinaryStrings strings;
+
+    QVector<XMVentBinaryJunction> junction( m_junction.count() );
+    for( int j = 0; j < m_junction.count(); j++ ) {
+        XMVentBinaryJunction& r = junction[j];
+        r.x = m_junction.point[j].x();
+        r.y = m_junction.point[j].y();
+        r.z = m_junction.point[j].z();
+        r.pressure = m_junction.pressure[j];
+        r.id = strings.intern( m_junction.id[j] );
+        r.flags = ( m_junction.isSurface( j ) ? XMVentBinarySurface : 0 )
+                  | ( m_junction.hasReferencePressure( j ) ? XMVentBinaryReferencePressure : 0 );
+    }
+
+    QVector<XMVentBinaryFan> fan( m_fanDefinition.count() );
+    QVector<XMVentBinaryPoint> point;
+    for( int f = 0; f < m_fanDefinition.count(); f++ ) {
+        const XMVentFan* source = m_fanDefinition[f];
+        const QVariantList curve = source->curve();
+        XMVentBinaryFan& r = fan[f];
+        r.id = strings.intern( source->id() );
+        r.fixedPressure = source->fixedPressure();
+        r.firstPoint = point.count();
+        r.pointCount = curve.count();
+        for( int i = 0; i < curve.count(); i++ ) {
+            const QVariantList p = curve[i].toList();
+            XMVentBinaryPoint q;
+            q.flow = p.value( 0 ).toFloat();
+            q.pressure = p.value( 1 ).toFloat();
+            point.append( q );
+        }
+    }
+
+    QVector<XMVentBinaryBranch> branch( m_branch.count() );
+    for( int b = 0; b < m_branch.count(); b++ ) {
+        XMVentBinaryBranch& r = branch[b];
+        r.from = m_branch.from[b];
+        r.to = m_branch.to[b];
+        r.resistance = m_branch.resistance[b];
+        r.n = m_branch.n[b];
+        r.id = strings.intern( m_branch.id[b] );
+        r.fan = m_fanDefinition.indexOf( m_fanList.value( b ) );
+    }
+
+    QVector<XMVentBinaryFixedFlow> fixedFlow;
+    fixedFlow.reserve( m_fixedFlow.count() );
+    QMap<int, float>::const_iterator itFixedFlow;
+    for( itFixedFlow = m_fixedFlow.begin(); itFixedFlow != m_fixedFlow.end(); itFixedFlow++ ) {
+        XMVentBinaryFixedFlow r;
+        r.branch = itFixedFlow.key();
+        r.flow = itFixedFlow.value();
+        fixedFlow.append( r );
+    }
+
+    const QByteArray mesh = ( withMesh ? m_solver.meshData() : QByteArray() );
+
+    XMVentBinaryHeader header;
+    header.magic = xmVentBinaryMagic;
+    header.version = xmVentBinaryVersion;
+    header.junctionCount = junction.count();
+    header.branchCount = branch.count();
+    header.fanCount = fan.count();
+    header.pointCount = point.count();
+    header.fixedFlowCount = fixedFlow.count();
+    header.stringCount = strings.offset.count() - 1;
+    header.stringBytes = strings.data.size();
+    header.meshBytes = mesh.size();
+    header.junctionOffset = xmVentBinaryAlign( sizeof( header ) );
+    header.branchOffset = xmVentBinaryAlign( header.junctionOffset + junction.count() * sizeof( XMVentBinaryJunction ) );
+    header.fanOffset = xmVentBinaryAlign( header.branchOffset + branch.count() * sizeof( XMVentBinaryBranch ) );
+    header.pointOffset = xmVentBinaryAlign( header.fanOffset + fan.count() * sizeof( XMVentBinaryFan ) );
+    header.fixedFlowOffset = xmVentBinaryAlign( header.pointOffset + point.count() * sizeof( XMVentBinaryPoint ) );
+    header.stringOffset = xmVentBinaryAlign( header.fixedFlowOffset + fixedFlow.count() * sizeof( XMVentBinaryFixedFlow ) );
+    header.meshOffset = xmVentBinaryAlign( header.stringOffset + strings.offset.count() * sizeof( quint32 )
+                                           + strings.data.size() );
+
+    QSaveFile file( filename );
+    if( !file.open( QIODevice::WriteOnly ) ) {
+        qDebug() << "Cannot write" << filename;
+        return false;
+    }
+    struct Section {
+        quint64 offset;
+        const void* data;
+        quint64 size;
+    } section[] = {
+        { 0, &header, sizeof( header ) },
+        { header.junctionOffset, junction.constData(), junction.count() * sizeof( XMVentBinaryJunction ) },
+        { header.branchOffset, branch.constData(), branch.count() * sizeof( XMVentBinaryBranch ) },
+        { header.fanOffset, fan.constData(), fan.count() * sizeof( XMVentBinaryFan ) },
+        { header.pointOffset, point.constData(), point.count() * sizeof( XMVentBinaryPoint ) },
+        { header.fixedFlowOffset, fixedFlow.constData(), fixedFlow.count() * sizeof( XMVentBinaryFixedFlow ) },
+        { header.stringOffset, strings.offset.constData(), strings.offset.count() * sizeof( quint32 ) },
+        { header.stringOffset + strings.offset.count() * sizeof( quint32 ), strings.data.constData(),
+          quint64( strings.data.size() ) },
+        { header.meshOffset, mesh.constData(), quint64( mesh.size() ) }
+    };
+    quint64 written = 0;
+    for( unsigned int i = 0; i < sizeof( section ) / sizeof( section[0] ); i++ ) {
+        // zero padding up to the section
+        if( section[i].offset > written ) {
+            file.write( QByteArray( int( section[i].offset - written ), 0 ) );
+        }
+        file.write( static_cast<const char*>( section[i].data ), section[i].size );
+        written = section[i].offset + section[i].size;
+    }
+
+    if( !file.commit() ) {
+        qDebug() << "Cannot write" << filename;
+        return false;
+    }
+    return true;
+}
+
+
+/// string i of the table, a null string for xmVentBinaryNoString; clears ok
+/// if there is no string i
+static QString xmVentBinaryString( const QVector<QString>& string, quint32 i, bool& ok )
+{
+    if( i == xmVentBinaryNoString ) {
+        return QString();
+    }
+    ok = ok && i < quint32( string.count() );
+    return string.value( i );
+}
+
+
+/// true if [offset, offset + count * size) lies within the file
+static bool xmVentBinaryInside( quint64 offset, quint64 count, quint64 size, quint64 fileSize )
+{
+    return offset <= fileSize && count <= ( fileSize - offset ) / size;
+}
+
+
+/// replace the network by the contents of a file written by toBinary().  The
+/// file is mapped, so loading touches only the pages of the tables.  The
+/// network tables are checked here; the mesh section is kept as it is and
+/// checked by XMVentSolveHC::readMesh() when initialize() uses it.
+bool XMVentNetwork::fromBinary( const QString& filename )
+{
+    clear();
+
+    QFile file( filename );
+    if( !file.open( QIODevice::ReadOnly ) ) {
+        return false;
+    }
+    const quint64 fileSize = file.size();
+    QByteArray contents;
+    const uchar* data = ( fileSize > 0 ? file.map( 0, fileSize ) : 0 );
+    if( !data ) {
+        contents = file.readAll();
+        data = reinterpret_cast<const uchar*>( contents.constData() );
+    }
+
+    XMVentBinaryHeader header;
+    if( fileSize < sizeof( header ) ) {
+        return false;
+    }
+    memcpy( &header, data, sizeof( header ) );
+    if( header.magic != xmVentBinaryMagic || header.version != xmVentBinaryVersion
+        || !xmVentBinaryInside( header.junctionOffset, header.junctionCount, sizeof( XMVentBinaryJunction ), fileSize )
+        || !xmVentBinaryInside( header.branchOffset, header.branchCount, sizeof( XMVentBinaryBranch ), fileSize )
+        || !xmVentBinaryInside( header.fanOffset, header.fanCount, sizeof( XMVentBinaryFan ), fileSize )
+        || !xmVentBinaryInside( header.pointOffset, header.pointCount, sizeof( XMVentBinaryPoint ), fileSize )
+        || !xmVentBinaryInside( header.fixedFlowOffset, header.fixedFlowCount, sizeof( XMVentBinaryFixedFlow ), fileSize )
+        || !xmVentBinaryInside( header.stringOffset, quint64( header.stringCount ) + 1, sizeof( quint32 ), fileSize )
+        || !xmVentBinaryInside( header.stringOffset + ( quint64( header.stringCount ) + 1 ) * sizeof( quint32 ),
+                                header.stringBytes, 1, fileSize )
+        || !xmVentBinaryInside( header.meshOffset, header.meshBytes, 1, fileSize )
+        || ( header.meshOffset | header.junctionOffset | header.branchOffset | header.fanOffset
+             | header.pointOffset | header.fixedFlowOffset | header.stringOffset ) % 8 != 0 ) {
+        qDebug() << "Not a binary network file:" << filename;
+        return false;
+    }
+
+    const XMVentBinaryJunction* junction = reinterpret_cast<const XMVentBinaryJunction*>( data + header.junctionOffset );
+    const XMVentBinaryBranch* branch = reinterpret_cast<const XMVentBinaryBranch*>( data + header.branchOffset );
+    const XMVentBinaryFan* fan = reinterpret_cast<const XMVentBinaryFan*>( data + header.fanOffset );
+    const XMVentBinaryPoint* point = reinterpret_cast<const XMVentBinaryPoint*>( data + header.pointOffset );
+    const XMVentBinaryFixedFlow* fixedFlow = reinterpret_cast<const XMVentBinaryFixedFlow*>( data + header.fixedFlowOffset );
+    const quint32* stringOffset = reinterpret_cast<const quint32*>( data + header.stringOffset );
+    const char* stringData = reinterpret_cast<const char*>( stringOffset + header.stringCount + 1 );
+
+    // ids are decoded once per distinct string
+    QVector<QString> string( header.stringCount );
+    for( quint32 i = 0; i < header.stringCount; i++ ) {
+        if( stringOffset[i] > stringOffset[i+1] || stringOffset[i+1] > header.stringBytes ) {
+            return false;
+        }
+        string[i] = QString::fromUtf8( stringData + stringOffset[i], stringOffset[i+1] - stringOffset[i] );
+    }
+    bool ok = true;
+
+    m_junction.reserve( header.junctionCount );
+    for( quint32 j = 0; j < header.junctionCount; j++ ) {
+        const XMVentBinaryJunction& r = junction[j];
+        const QString id = xmVentBinaryString( string, r.id, ok );
+        m_junction.append( QStringRef( &id ), QVector3D( r.x, r.y, r.z ), r.flags & XMVentBinarySurface );
+        m_junction.pressure[j] = r.pressure;
+        m_junction.setFlag( j, XMVentJunctionTable::ReferencePressure, r.flags & XMVentBinaryReferencePressure );
+    }
+
+    for( quint32 f = 0; f < header.fanCount; f++ ) {
+        const XMVentBinaryFan& r = fan[f];
+        XMVentFan* target = new XMVentFan( this );
+        target->setId( xmVentBinaryString( string, r.id, ok ) );
+        target->setFixedPressure( r.fixedPressure );
+        ok = ok && r.firstPoint <= header.pointCount && r.pointCount <= header.pointCount - r.firstPoint;
+        for( quint32 i = 0; ok && i < r.pointCount; i++ ) {
+            target->addCurvePoint( point[ r.firstPoint + i ].flow, point[ r.firstPoint + i ].pressure );
+        }
+        m_fanDefinition.append( target );
+    }
+
+    m_branch.reserve( header.branchCount );
+    for( quint32 b = 0; b < header.branchCount; b++ ) {
+        const XMVentBinaryBranch& r = branch[b];
+        const QString id = xmVentBinaryString( string, r.id, ok );
+        m_branch.append( QStringRef( &id ), r.from, r.to, r.resistance, r.n );
+        ok = ok && r.from < header.junctionCount && r.to < header.junctionCount && r.fan < qint32( header.fanCount );
+        if( ok && r.fan >= 0 ) {
+            m_fanList.insert( b, m_fanDefinition[ r.fan ] );
+        }
+    }
+
+    for( quint32 i = 0; i < header.fixedFlowCount; i++ ) {
+        ok = ok && fixedFlow[i].branch < header.branchCount;
+        m_fixedFlow.insert( fixedFlow[i].branch, fixedFlow[i].flow );
+    }
+
+    if( !ok ) {
+        qDebug() << "Inconsistent binary network file:" << filename;
+        clear();
+        return false;
+    }
+
+    // a mesh section that does not fit is ignored by initialize()
+    if( header.meshBytes > 0 ) {
+        m_solver.setMeshData( QByteArray( reinterpret_cast<const char*>( data + header.meshOffset ), header.meshBytes ) );
+    }
+    return true;
+}
@@ -0,0 +1,108 @@
+/*
+ *  Copyright (C) 2010 Andrew Wilson.
+ *  All rights reserved.
+ *  Contact email: amwgeo@gmail.com
+ *
+ *  This file is part of xmlMine-Vent
+ *
+ *  xmlMine-Vent is free software: you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation, either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  xmlMine-Vent is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General
+ *  Public License along with xmlMine-Vent.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef XMVENTBINARY_H
+#define XMVENTBINARY_H
+
+#include "xmvent-global.h"
+
+#include <QtGlobal>
+
+
+/// Layout of the binary network file (.xmvb), written and read by
+/// XMVentNetwork::toBinary() / fromBinary().  The file is the header
+/// followed by the sections it locates, each 8 byte aligned, in the byte
+/// order of the host that wrote it; a file of the other byte order does not
+/// pass the magic test.  Ids are indexes into the string table, which keeps
+/// each distinct string once.
+///
+///   header
+///   junction table       XMVentBinaryJunction[ junctionCount ]
+///   branch table         XMVentBinaryBranch[ branchCount ]
+///   fan table            XMVentBinaryFan[ fanCount ]
+///   fan curve points     XMVentBinaryPoint[ pointCount ]
+///   fixed flows          XMVentBinaryFixedFlow[ fixedFlowCount ]
+///   string offsets       quint32[ stringCount + 1 ] into the string data
+///   string data          UTF-8, stringBytes long
+///   meshes               meshBytes of XMVentSolveHC::meshData(), optional
+struct XMVentBinaryHeader {
+    quint32 magic;
+    quint32 version;
+    quint32 junctionCount;
+    quint32 branchCount;
+    quint32 fanCount;
+    quint32 pointCount;
+    quint32 fixedFlowCount;
+    quint32 stringCount;
+    quint32 stringBytes;
+    quint32 meshBytes;
+    quint64 junctionOffset;
+    quint64 branchOffset;
+    quint64 fanOffset;
+    quint64 pointOffset;
+    quint64 fixedFlowOffset;
+    quint64 stringOffset;           // string offsets, then string data
+    quint64 meshOffset;
+};
+
+/// "XMVB" read as a host order quint32
+static const quint32 xmVentBinaryMagic = 0x42564d58;
+static const quint32 xmVentBinaryVersion = 1;
+static const quint32 xmVentBinaryNoString = 0xffffffff;     // a null id
+
+struct XMVentBinaryJunction {
+    float x, y, z;
+    float pressure;
+    quint32 id;
+    quint32 flags;
+};
+
+enum XMVentBinaryJunctionFlag { XMVentBinarySurface = 1, XMVentBinaryReferencePressure = 2 };
+
+struct XMVentBinaryBranch {
+    quint32 from, to;               // junction index
+    float resistance;
+    float n;
+    quint32 id;
+    qint32 fan;                     // fan definition index, -1 for none
+};
+
+struct XMVentBinaryFan {
+    quint32 id;
+    float fixedPressure;
+    quint32 firstPoint;             // characteristic points [firstPoint, firstPoint + pointCount)
+    quint32 pointCount;
+};
+
+struct XMVentBinaryPoint {
+    float flow;
+    float pressure;
+};
+
+struct XMVentBinaryFixedFlow {
+    quint32 branch;
+    float flow;
+};
+
+
+#endif // XMVENTBINARY_H
@@ -23,70 +23,105 @@
 
 #include "branch.h"
 
-XMVentBranch::XMVentBranch(QObject *parent) :
-    QObject(parent)
+
+/// add a branch, returning its index
+int XMVentBranchTable::append( const QStringRef& branchId, int fromId, int toId, float r, float branchN )
+{
+    id.append( branchId );
+    from.append( fromId );
+    to.append( toId );
+    resistance.append( r );
+    n.append( branchN );
+    return id.count() - 1;
+}
+
+
+void XMVentBranchTable::reserve( int count )
+{
+    id.reserve( count );
+    from.reserve( count );
+    to.reserve( count );
+    resistance.reserve( count );
+    n.reserve( count );
+}
+
+
+void XMVentBranchTable::clear()
+{
+    id.clear();
+    from.clear();
+    to.clear();
+    resistance.clear();
+    n.clear();
+}
+
+
+XMVentBranch::XMVentBranch( XMVentBranchTable& table, int index, QObject *parent ) :
+    QObject(parent), m_table( table ), m_index( index )
+{
+}
+
+
+int XMVentBranch::index() const
 {
-    m_fromId = -1;
-    m_toId = -1;
-    m_resistance = 0.;
-    m_n = 2.;
+    return m_index;
 }
 
 
 QString XMVentBranch::id() const
 {
-    return m_id;
+    return m_table.id[ m_index ];
 }
 
 
 void XMVentBranch::setId( const QString& id )
 {
-    m_id = id;
+    m_table.id.set( m_index, id );
 }
 
 
 int XMVentBranch::fromId() const
 {
-    return m_fromId;
+    return m_table.from[ m_index ];
 }
 
 
 void XMVentBranch::setFromId( int fromId )
 {
-    m_fromId = fromId;
+    m_table.from[ m_index ] = fromId;
 }
 
 
 int XMVentBranch::toId() const
 {
-    return m_toId;
+    return m_table.to[ m_index ];
 }
 
 
 void XMVentBranch::setToId( int toId )
 {
-    m_toId = toId;
+    m_table.to[ m_index ] = toId;
 }
 
 float XMVentBranch::resistance() const
 {
-    return m_resistance;
+    return m_table.resistance[ m_index ];
 }
 
 
 void XMVentBranch::setResistance( float resistance )
 {
-    m_resistance = resistance;
+    m_table.resistance[ m_index ] = resistance;
 }
 
 
 float XMVentBranch::n() const
 {
-    return m_n;
+    return m_table.n[ m_index ];
 }
 
 
 void XMVentBranch::setN( float n )
 {
-    m_n = n;
+    m_table.n[ m_index ] = n;
 }
@@ -29,10 +29,36 @@
 
 #include <QObject>
 #include <QString>
+#include <QVector>
 
+#include "stringarena.h"
+
+
+/// Branches of a network in columns: entry b of every vector belongs to
+/// branch b.
+struct XMVENTSHARED_EXPORT XMVentBranchTable {
+    XMVentStringArena id;
+    QVector<int> from;              // junction index
+    QVector<int> to;
+    QVector<float> resistance;
+    QVector<float> n;               // pressure loss r |Q|^(n-1) Q
+
+    int count() const { return id.count(); }
+    int size() const { return id.count(); }
+    bool isEmpty() const { return id.isEmpty(); }
+
+    int append( const QStringRef& id, int from, int to, float resistance, float n = 2.f );
+    void reserve( int count );
+    void clear();
+};
+
+
+/// Branch of a network as a QObject for scripts and item views, made on
+/// demand by XMVentNetwork::branch().  It holds no data of its own.
 class XMVENTSHARED_EXPORT XMVentBranch : public QObject
 {
     Q_OBJECT
+    Q_PROPERTY( int index READ index )
     Q_PROPERTY( QString id READ id WRITE setId )
     Q_PROPERTY( int fromId READ fromId WRITE setFromId )
     Q_PROPERTY( int toId READ toId WRITE setToId )
@@ -40,15 +66,14 @@ class XMVENTSHARED_EXPORT XMVentBranch : public QObject
     Q_PROPERTY( float n READ n WRITE setN )
 
 protected:
-    QString m_id;
-    int m_fromId, m_toId;
-    float m_resistance;
-    float m_n;
+    XMVentBranchTable& m_table;
+    int m_index;
 
 public:
 
-    explicit XMVentBranch(QObject *parent = 0);
+    XMVentBranch( XMVentBranchTable& table, int index, QObject *parent = 0 );
 
+    int index() const;
     QString id() const;
     int fromId() const;
     int toId() const;
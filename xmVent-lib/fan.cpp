@@ -23,6 +23,8 @@
 
 #include "fan.h"
 
+#include <QPair>
+
 
 XMVentFan::XMVentFan(QObject *parent) :
     QObject(parent)
@@ -54,3 +56,147 @@ void XMVentFan::setFixedPressure( float fixedPressure )
     m_fixedPressure = fixedPressure;
 }
 
+
+static bool xmVentFanPointLess( const QPair<float,float>& a, const QPair<float,float>& b )
+{
+    return a.first < b.first;
+}
+
+
+/// flow and pressure points in any order; points of equal flow keep the last pressure
+void XMVentFanCurve::compile( const QVector<float>& flow, const QVector<float>& pressure )
+{
+    m_flow.clear();
+    m_a.clear();
+    m_b.clear();
+    m_c.clear();
+    m_d.clear();
+
+    QVector<QPair<float,float> > point;
+    for( int i = 0; i < flow.count() && i < pressure.count(); i++ ) {
+        point.append( qMakePair( flow[i], pressure[i] ) );
+    }
+    std::stable_sort( point.begin(), point.end(), xmVentFanPointLess );
+    QVector<float> q, p;
+    for( int i = 0; i < point.count(); i++ ) {
+        if( !q.isEmpty() && q.last() == point[i].first ) {
+            p.last() = point[i].second;
+        } else {
+            q.append( point[i].first );
+            p.append( point[i].second );
+        }
+    }
+    const int n = q.count();
+    if( n == 0 ) {
+        return;
+    }
+
+    // secant of each interval, then knot slopes that keep every interval monotone
+    QVector<double> h( n ), secant( n ), slope( n, 0. );
+    for( int i = 0; i + 1 < n; i++ ) {
+        h[ i ] = q[i+1] - q[i];
+        secant[ i ] = ( p[i+1] - p[i] ) / h[i];
+    }
+    if( n > 1 ) {
+        slope[ 0 ] = secant[ 0 ];
+        slope[ n-1 ] = secant[ n-2 ];
+    }
+    for( int i = 1; i + 1 < n; i++ ) {
+        if( secant[i-1] * secant[i] > 0. ) {
+            // weighted harmonic mean (Fritsch-Butland)
+            slope[ i ] = 3. * ( h[i-1] + h[i] )
+                         / ( ( 2. * h[i] + h[i-1] ) / secant[i-1] + ( h[i] + 2. * h[i-1] ) / secant[i] );
+        }
+    }
+
+    // a cubic per interval, then the line after the last point
+    for( int i = 0; i + 1 < n; i++ ) {
+        m_flow.append( q[i] );
+        m_a.append( p[i] );
+        m_b.append( slope[i] );
+        m_c.append( ( 3. * secant[i] - 2. * slope[i] - slope[i+1] ) / h[i] );
+        m_d.append( ( slope[i] + slope[i+1] - 2. * secant[i] ) / ( h[i] * h[i] ) );
+    }
+    m_flow.append( q[n-1] );
+    m_a.append( p[n-1] );
+    m_b.append( slope[n-1] );
+    m_c.append( 0.f );
+    m_d.append( 0.f );
+}
+
+
+bool XMVentFan::hasCurve() const
+{
+    return !m_curveFlow.isEmpty();
+}
+
+
+/// characteristic as [ [flow, pressure], ... ]
+QVariantList XMVentFan::curve() const
+{
+    QVariantList r;
+    for( int i = 0; i < m_curveFlow.count(); i++ ) {
+        QVariantList point;
+        point.append( m_curveFlow[i] );
+        point.append( m_curvePressure[i] );
+        r.append( QVariant( point ) );
+    }
+    return r;
+}
+
+
+/// replace the characteristic, an empty list returns to fixedPressure.
+/// Takes effect at the next solve().
+void XMVentFan::setCurve( const QVariantList& curve )
+{
+    m_curveFlow.clear();
+    m_curvePressure.clear();
+    for( int i = 0; i < curve.count(); i++ ) {
+        const QVariantList point = curve[i].toList();
+        if( point.count() == 2 ) {
+            m_curveFlow.append( point[0].toFloat() );
+            m_curvePressure.append( point[1].toFloat() );
+        }
+    }
+    m_compiledCurve.compile( m_curveFlow, m_curvePressure );
+}
+
+
+void XMVentFan::addCurvePoint( float flow, float pressure )
+{
+    m_curveFlow.append( flow );
+    m_curvePressure.append( pressure );
+    m_compiledCurve.compile( m_curveFlow, m_curvePressure );
+}
+
+
+/// sample p = c0 + c1 Q + c2 Q^2 + ... over [minFlow, maxFlow] into curve points
+bool XMVentFan::setPolynomial( const QVector<float>& coefficient, float minFlow, float maxFlow )
+{
+    const int nPoints = 33;
+    if( coefficient.isEmpty() || !( maxFlow > minFlow ) ) {
+        return false;
+    }
+
+    m_curveFlow.clear();
+    m_curvePressure.clear();
+    for( int i = 0; i < nPoints; i++ ) {
+        const double q = minFlow + ( maxFlow - minFlow ) * i / ( nPoints - 1 );
+        double p = 0.;
+        for( int k = coefficient.count() - 1; k >= 0; k-- ) {
+            p = p * q + coefficient[k];
+        }
+        m_curveFlow.append( q );
+        m_curvePressure.append( p );
+    }
+    m_compiledCurve.compile( m_curveFlow, m_curvePressure );
+    return true;
+}
+
+
+/// lookup table of the characteristic, empty if the fan has a fixed pressure.
+/// It is compiled when the points change, not by the solver.
+const XMVentFanCurve& XMVentFan::compiledCurve() const
+{
+    return m_compiledCurve;
+}
@@ -27,16 +27,61 @@
 #include "xmvent-global.h"
 
 #include <QObject>
+#include <QVector>
+#include <QVariantList>
+
+#include <algorithm>
+
+
+/// Fan pressure against flow, a monotone piecewise cubic (Fritsch-Butland)
+/// through the curve points and straight lines beyond the end points.  Each
+/// interval keeps its cubic coefficients so pressure and dP/dQ cost a search
+/// of the interval and two Horner sums.
+class XMVENTSHARED_EXPORT XMVentFanCurve
+{
+protected:
+    QVector<float> m_flow;              // interval start flows, ascending
+    QVector<float> m_a, m_b, m_c, m_d;  // p = a + b t + c t^2 + d t^3, t = Q - flow
+
+public:
+    void compile( const QVector<float>& flow, const QVector<float>& pressure );
+    bool isEmpty() const { return m_flow.isEmpty(); }
+    bool operator==( const XMVentFanCurve& other ) const {
+        return m_flow == other.m_flow && m_a == other.m_a && m_b == other.m_b
+               && m_c == other.m_c && m_d == other.m_d;
+    }
+
+    /// pressure at flow q, dP/dQ in slope
+    template<typename Real>
+    Real pressure( Real q, Real& slope ) const {
+        const float* start = m_flow.constData();
+        const int i = int( std::upper_bound( start, start + m_flow.count(), float( q ) ) - start ) - 1;
+        if( i < 0 ) {
+            // below the first point continue its slope
+            slope = m_b[0];
+            return m_a[0] + ( q - Real( start[0] ) ) * slope;
+        }
+        const Real t = q - Real( start[i] );
+        const Real b = m_b[i], c = m_c[i], d = m_d[i];
+        slope = b + t * ( Real( 2. ) * c + t * Real( 3. ) * d );
+        return m_a[i] + t * ( b + t * ( c + t * d ) );
+    }
+};
+
 
 class XMVENTSHARED_EXPORT XMVentFan : public QObject
 {
     Q_OBJECT
     Q_PROPERTY( QString id READ id WRITE setId )
     Q_PROPERTY( float fixedPressure READ fixedPressure WRITE setFixedPressure )
+    Q_PROPERTY( QVariantList curve READ curve WRITE setCurve )
 
 protected:
     QString m_id;
     float m_fixedPressure;
+    QVector<float> m_curveFlow;         // characteristic points, used instead of
+    QVector<float> m_curvePressure;     // fixedPressure when there are any
+    XMVentFanCurve m_compiledCurve;     // the points compiled, after every change
 
 public:
     explicit XMVentFan(QObject *parent = 0);
@@ -47,6 +92,13 @@ public:
     float fixedPressure() const;
     void setFixedPressure( float fixedPressure );
 
+    bool hasCurve() const;
+    QVariantList curve() const;
+    void setCurve( const QVariantList& curve );
+    void addCurvePoint( float flow, float pressure );
+    bool setPolynomial( const QVector<float>& coefficient, float minFlow, float maxFlow );
+    const XMVentFanCurve& compiledCurve() const;
+
 signals:
 
 public slots:
@@ -24,52 +24,114 @@
 #include "junction.h"
 
 
-XMVentJunction::XMVentJunction(QObject *parent) :
-    QObject(parent)
+void XMVentJunctionTable::setFlag( int j, Flag flag, bool on )
 {
-    referencePressure = false;
-    pressure = 0.;
-    m_surface = false;
+    if( on ) {
+        flags[j] |= flag;
+    } else {
+        flags[j] &= ~flag;
+    }
 }
 
 
-QString XMVentJunction::id() const
+/// fix the pressure of junction j
+void XMVentJunctionTable::setPressure( int j, float p )
 {
-    return m_id;
+    pressure[j] = p;
+    flags[j] |= ReferencePressure;
 }
 
 
-void XMVentJunction::setId( const QString& id )
+/// add a junction, returning its index
+int XMVentJunctionTable::append( const QStringRef& junctionId, const QVector3D& junctionPoint, bool surface )
+{
+    id.append( junctionId );
+    point.append( junctionPoint );
+    pressure.append( 0.f );
+    flags.append( surface ? Surface : 0 );
+    return id.count() - 1;
+}
+
+
+void XMVentJunctionTable::reserve( int n )
+{
+    id.reserve( n );
+    point.reserve( n );
+    pressure.reserve( n );
+    flags.reserve( n );
+}
+
+
+void XMVentJunctionTable::clear()
+{
+    id.clear();
+    point.clear();
+    pressure.clear();
+    flags.clear();
+}
+
+
+XMVentJunction::XMVentJunction( XMVentJunctionTable& table, int index, QObject *parent ) :
+    QObject(parent), m_table( table ), m_index( index )
+{
+}
+
+
+int XMVentJunction::index() const
 {
-    m_id = id;
+    return m_index;
 }
 
 
-const QVector3D& XMVentJunction::point() const
+QString XMVentJunction::id() const
 {
-    return m_point;
+    return m_table.id[ m_index ];
 }
 
 
-QVector3D& XMVentJunction::point()
+void XMVentJunction::setId( const QString& id )
 {
-    return m_point;
+    m_table.id.set( m_index, id );
+}
+
+
+QVector3D XMVentJunction::point() const
+{
+    return m_table.point[ m_index ];
 }
 
 
 void XMVentJunction::setPoint( const QVector3D& point )
 {
-    m_point = point;
+    m_table.point[ m_index ] = point;
 }
 
 
 bool XMVentJunction::isSurface() const
 {
-    return m_surface;
+    return m_table.isSurface( m_index );
 }
 
 
 void XMVentJunction::setSurface( bool surface )
 {
-    m_surface = surface;
+    m_table.setFlag( m_index, XMVentJunctionTable::Surface, surface );
+}
+
+
+bool XMVentJunction::hasReferencePressure() const
+{
+    return m_table.hasReferencePressure( m_index );
+}
+
+
+float XMVentJunction::pressure() const
+{
+    return m_table.pressure[ m_index ];
+}
+
+
+void XMVentJunction::setPressure( float pressure )
+{
+    m_table.setPressure( m_index, pressure );
 }
@@ -28,32 +28,61 @@
 
 #include <QObject>
 #include <QString>
+#include <QVector>
 #include <QVector3D>
 
+#include "stringarena.h"
+
+
+/// Junctions of a network in columns: entry j of every vector belongs to
+/// junction j.
+struct XMVENTSHARED_EXPORT XMVentJunctionTable {
+    enum Flag { Surface = 1, ReferencePressure = 2 };
+
+    XMVentStringArena id;
+    QVector<QVector3D> point;       // adjacent, usable as a GL vertex buffer
+    QVector<float> pressure;        // fixed pressure of a ReferencePressure junction
+    QVector<quint8> flags;
+
+    int count() const { return id.count(); }
+    int size() const { return id.count(); }
+    bool isEmpty() const { return id.isEmpty(); }
+    bool isSurface( int j ) const { return flags[j] & Surface; }
+    bool hasReferencePressure( int j ) const { return flags[j] & ReferencePressure; }
+    void setFlag( int j, Flag flag, bool on );
+    void setPressure( int j, float p );
+
+    int append( const QStringRef& id, const QVector3D& point, bool surface = false );
+    void reserve( int n );
+    void clear();
+};
+
+
+/// Junction of a network as a QObject for scripts and item views, made on
+/// demand by XMVentNetwork::junction().  It holds no data of its own.
 class XMVENTSHARED_EXPORT XMVentJunction : public QObject
 {
     Q_OBJECT
+    Q_PROPERTY( int index READ index )
     Q_PROPERTY( QString id READ id WRITE setId )
     Q_PROPERTY( QVector3D point READ point WRITE setPoint )
     Q_PROPERTY( bool surface READ isSurface WRITE setSurface )
+    Q_PROPERTY( bool referencePressure READ hasReferencePressure )
+    Q_PROPERTY( float pressure READ pressure WRITE setPressure )
 
 protected:
-    QString m_id;
-    QVector3D m_point;
-    bool m_surface;
+    XMVentJunctionTable& m_table;
+    int m_index;
 
 public:
-    float pressure;             // TODO:AW: make this property
-    bool referencePressure;     // TODO:AW: make this property
-
-    explicit XMVentJunction( QObject *parent = 0 );
-
-    //void glVertex() const;
+    XMVentJunction( XMVentJunctionTable& table, int index, QObject *parent = 0 );
 
+    int index() const;
     QString id() const;
-    const QVector3D& point() const;
-    QVector3D& point();         // TODO:AW: changes can occur outside setPoint(...)
+    QVector3D point() const;
     bool isSurface() const;
+    bool hasReferencePressure() const;
+    float pressure() const;
 
 signals:
 
@@ -61,6 +90,7 @@ public slots:
     void setId( const QString& id );
     void setPoint( const QVector3D& point );
     void setSurface( bool surface );
+    void setPressure( float pressure );
 };
 
 #endif // XMVENTJUNCTION_H
@@ -0,0 +1,167 @@
+/*
+ *  Copyright (C) 2010 Andrew Wilson.
+ *  All rights reserved.
+ *  Contact email: amwgeo@gmail.com
+ *
+ *  This file is part of xmlMine-Vent
+ *
+ *  xmlMine-Vent is free software: you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation, either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  xmlMine-Vent is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General
+ *  Public License along with xmlMine-Vent.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "meshkernel.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#  define XMVENT_KERNEL_X86
+#  include <immintrin.h>
+#  if defined(_MSC_VER)
+#    include <intrin.h>
+#  endif
+#endif
+
+// GCC and Clang only emit AVX2 code for functions marked as such; MSVC always can
+#if defined(__GNUC__)
+#  define XMVENT_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#  define XMVENT_TARGET_AVX2
+#endif
+
+
+#ifdef XMVENT_KERNEL_X86
+
+static inline float horizontalSum( __m128 v )
+{
+    __m128 shuffle = _mm_shuffle_ps( v, v, _MM_SHUFFLE( 2, 3, 0, 1 ) );
+    __m128 sum = _mm_add_ps( v, shuffle );
+    shuffle = _mm_movehl_ps( shuffle, sum );
+    return _mm_cvtss_f32( _mm_add_ss( sum, shuffle ) );
+}
+
+
+/// SSE2, four steps at a time.  Without a gather instruction the flows are loaded one by one.
+template<int N>
+static void meshKernelSSE2( const float* flow, const XMVentMeshSteps& steps, int begin, int end,
+                            float& pressure, float& slope )
+{
+    const __m128 absMask = _mm_castsi128_ps( _mm_set1_epi32( 0x7fffffff ) );
+    __m128 p = _mm_setzero_ps();
+    __m128 s = _mm_setzero_ps();
+
+    int k = begin;
+    for( ; k + 4 <= end; k += 4 ) {
+        const int* b = steps.branch + k;
+        const qint8* d = steps.direction + k;
+        __m128 q = _mm_set_ps( d[3] * flow[ b[3] ], d[2] * flow[ b[2] ], d[1] * flow[ b[1] ], d[0] * flow[ b[0] ] );
+        __m128 r = _mm_loadu_ps( steps.resistance + k );
+        __m128 rq = ( N == 2 ? _mm_mul_ps( r, _mm_and_ps( q, absMask ) ) : r );
+        p = _mm_add_ps( p, _mm_sub_ps( _mm_mul_ps( rq, q ), _mm_loadu_ps( steps.fanPressure + k ) ) );
+        s = _mm_add_ps( s, rq );
+    }
+
+    pressure += horizontalSum( p );
+    slope += N * horizontalSum( s );
+    xmVentMeshKernelScalar<N,float,float>( flow, steps, k, end, pressure, slope );
+}
+
+
+/// AVX2, eight steps at a time with gathered flows
+template<int N>
+static XMVENT_TARGET_AVX2 void meshKernelAVX2( const float* flow, const XMVentMeshSteps& steps, int begin, int end,
+                            float& pressure, float& slope )
+{
+    const __m256 absMask = _mm256_castsi256_ps( _mm256_set1_epi32( 0x7fffffff ) );
+    __m256 p = _mm256_setzero_ps();
+    __m256 s = _mm256_setzero_ps();
+
+    int k = begin;
+    for( ; k + 8 <= end; k += 8 ) {
+        __m256i b = _mm256_loadu_si256( (const __m256i*)( steps.branch + k ) );
+        __m256i d = _mm256_cvtepi8_epi32( _mm_loadl_epi64( (const __m128i*)( steps.direction + k ) ) );
+        __m256 q = _mm256_mul_ps( _mm256_i32gather_ps( flow, b, 4 ), _mm256_cvtepi32_ps( d ) );
+        __m256 r = _mm256_loadu_ps( steps.resistance + k );
+        __m256 rq = ( N == 2 ? _mm256_mul_ps( r, _mm256_and_ps( q, absMask ) ) : r );
+        p = _mm256_add_ps( p, _mm256_sub_ps( _mm256_mul_ps( rq, q ), _mm256_loadu_ps( steps.fanPressure + k ) ) );
+        s = _mm256_add_ps( s, rq );
+    }
+
+    pressure += horizontalSum( _mm_add_ps( _mm256_castps256_ps128( p ), _mm256_extractf128_ps( p, 1 ) ) );
+    slope += N * horizontalSum( _mm_add_ps( _mm256_castps256_ps128( s ), _mm256_extractf128_ps( s, 1 ) ) );
+    xmVentMeshKernelScalar<N,float,float>( flow, steps, k, end, pressure, slope );
+}
+
+
+static bool cpuHasAVX2()
+{
+#if defined(__GNUC__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports( "avx2" );
+#elif defined(_MSC_VER)
+    int info[ 4 ];
+    __cpuid( info, 0 );
+    if( info[0] < 7 ) {
+        return false;
+    }
+
+    // AVX and OSXSAVE, then the OS must save the XMM and YMM state
+    __cpuid( info, 1 );
+    const int avxOsxsave = ( 1 << 28 ) | ( 1 << 27 );
+    if( ( info[2] & avxOsxsave ) != avxOsxsave || ( _xgetbv( 0 ) & 6 ) != 6 ) {
+        return false;
+    }
+
+    __cpuidex( info, 7, 0 );
+    return ( info[1] & ( 1 << 5 ) ) != 0;
+#else
+    return false;
+#endif
+}
+
+#endif // XMVENT_KERNEL_X86
+
+
+static XMVentMeshKernel meshKernelSelect()
+{
+    XMVentMeshKernel kernel;
+
+#ifdef XMVENT_KERNEL_X86
+    if( cpuHasAVX2() ) {
+        kernel.square = &meshKernelAVX2<2>;
+        kernel.linear = &meshKernelAVX2<1>;
+        kernel.width = 8;
+        kernel.name = "avx2";
+        return kernel;
+    }
+#  if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+    kernel.square = &meshKernelSSE2<2>;
+    kernel.linear = &meshKernelSSE2<1>;
+    kernel.width = 4;
+    kernel.name = "sse2";
+    return kernel;
+#  endif
+#endif
+
+    kernel.square = &xmVentMeshKernelScalar<2,float,float>;
+    kernel.linear = &xmVentMeshKernelScalar<1,float,float>;
+    kernel.width = 1;
+    kernel.name = "scalar";
+    return kernel;
+}
+
+
+const XMVentMeshKernel& XMVentMeshKernel::instance()
+{
+    static const XMVentMeshKernel kernel = meshKernelSelect();
+    return kernel;
+}
@@ -0,0 +1,83 @@
+/*
+ *  Copyright (C) 2010 Andrew Wilson.
+ *  All rights reserved.
+ *  Contact email: amwgeo@gmail.com
+ *
+ *  This file is part of xmlMine-Vent
+ *
+ *  xmlMine-Vent is free software: you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation, either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  xmlMine-Vent is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General
+ *  Public License along with xmlMine-Vent.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef XMVENTMESHKERNEL_H
+#define XMVENTMESHKERNEL_H
+
+#include "xmvent-global.h"
+
+#include <cmath>
+
+
+/// Step arrays of a mesh program as seen by the kernels
+struct XMVentMeshSteps {
+    const int* branch;
+    const qint8* direction;
+    const float* resistance;
+    const float* n;
+    const float* fanPressure;   // signed by step direction
+};
+
+
+/// Scalar kernel; N is the exponent of every step in the run, 0 for any exponent.
+/// Flow is the storage type of the flows and Real the type the sums are
+/// accumulated in.  Inline so that short runs do not pay for a call through
+/// the dispatch table.
+template<int N, typename Flow, typename Real>
+inline void xmVentMeshKernelScalar( const Flow* flow, const XMVentMeshSteps& steps, int begin, int end,
+                                    Real& pressure, Real& slope )
+{
+    Real p = 0., s = 0.;
+    for( int k = begin; k < end; k++ ) {
+        Real q = steps.direction[ k ] * Real( flow[ steps.branch[k] ] );
+        Real n = ( N == 0 ? Real( steps.n[ k ] ) : Real( N ) );
+        Real rq = ( N == 2 ? Real( fabs(q) ) : ( N == 1 ? Real( 1. ) : Real( pow( fabs(q), n - Real( 1. ) ) ) ) )
+                  * steps.resistance[ k ];
+        p += rq * q - steps.fanPressure[ k ];
+        s += n * rq;
+    }
+    pressure += p;
+    slope += s;
+}
+
+
+/// Sums over a run of mesh steps of the pressure R|Q|^(n-1)Q - fan and its
+/// slope nR|Q|^(n-1).  square() and linear() assume n == 2 and n == 1 for
+/// every step of the run.  Each function adds to pressure / slope.  These work
+/// on float flows with float sums; other exponents and the other precisions
+/// use xmVentMeshKernelScalar.
+struct XMVENTSHARED_EXPORT XMVentMeshKernel {
+    typedef void (*Function)( const float* flow, const XMVentMeshSteps& steps, int begin, int end,
+                              float& pressure, float& slope );
+
+    Function square;
+    Function linear;
+    int width;                  // steps per vector, shorter runs are best done inline
+    const char* name;
+
+    /// best kernel set for the running CPU, chosen on first use
+    static const XMVentMeshKernel& instance();
+};
+
+
+#endif // XMVENTMESHKERNEL_H
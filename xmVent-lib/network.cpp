@@ -23,9 +23,11 @@
 
 #include "network.h"
 
-#include <QtXml>
+#include <QFile>
+#include <QHash>
 #include <QMap>
 #include <QQmlEngine>
+#include <QXmlStreamReader>
 
 
 #include "junction.h"
@@ -35,65 +37,90 @@
 Q_DECLARE_METATYPE(QList<float>)
 
 
-class XMVentNetworkParser: public QXmlDefaultHandler
+/// Pull parser of the network XML.  Attribute values are read as string
+/// references into the reader's buffer; only ids are copied, into the id
+/// arenas of the network.  Junction ids resolve through a hash of references
+/// into that arena, sized from a first pass over the file.
+class XMVentNetworkParser
 {
 protected:
-    QString scriptCode;
-    bool insideScript;
+    QXmlStreamReader m_reader;
+    XMVentFan* currentFan;        // <fan> being read, for its <point> elements
     XMVentNetwork& m_ventNet;
-    QMap<QString, unsigned int> junctionMap;
+    QHash<QStringRef, int> junctionMap;
 
     XMVentNetworkParser( XMVentNetwork& ventNet ) :
         m_ventNet( ventNet )
     {
-        insideScript = false;
+        currentFan = 0;
     }
 
 public:
-    bool startDocument() {
-        m_ventNet.clear();
-        return true;
-    }
+    /// count the junction and branch elements of a random access device, then
+    /// seek back.  Only a size hint: elements in comments count as well.
+    static void countElements( QIODevice* dev, int& junctions, int& branches )
+    {
+        junctions = 0;
+        branches = 0;
+        if( dev->isSequential() ) {
+            return;
+        }
 
-    bool endDocument() {
-        return true;
+        const qint64 start = dev->pos();
+        const QByteArray junctionTag( "<junction " );
+        const QByteArray branchTag( "<branch " );
+        QByteArray chunk;
+        int kept = 0;
+        while( !dev->atEnd() ) {
+            // keep the end of the last chunk to find tags split between chunks;
+            // tags lying entirely in the kept part were counted already
+            chunk = chunk.right( junctionTag.size() - 1 );
+            kept = chunk.size();
+            chunk += dev->read( 1 << 20 );
+            for( int i = chunk.indexOf( junctionTag ); i >= 0; i = chunk.indexOf( junctionTag, i + 1 ) ) {
+                junctions += ( i + junctionTag.size() > kept );
+            }
+            for( int i = chunk.indexOf( branchTag ); i >= 0; i = chunk.indexOf( branchTag, i + 1 ) ) {
+                branches += ( i + branchTag.size() > kept );
+            }
+        }
+        dev->seek( start );
     }
 
-    bool addJunction( const QXmlAttributes& atts )
+    bool addJunction( const QXmlStreamAttributes& atts )
     {
-        XMVentJunction* junction = new XMVentJunction( &m_ventNet );
-
         bool ok_x, ok_y, ok_z, ok_p = true;
-        junction->point().setX( atts.value( "x" ).toFloat( &ok_x ) );
-        junction->point().setY( atts.value( "y" ).toFloat( &ok_y ) );
-        junction->point().setZ( atts.value( "z" ).toFloat( &ok_z ) );
-        junction->setId( atts.value( "id" ) );
-        junction->setSurface( 0 == atts.value( "surface" ).compare("true", Qt::CaseInsensitive) );
-        if( -1 != atts.index("pressure") ) {
-            junction->pressure = atts.value("pressure").toFloat( &ok_p );
-            junction->referencePressure = true;
+        const QVector3D point( atts.value( QLatin1String( "x" ) ).toFloat( &ok_x ),
+                               atts.value( QLatin1String( "y" ) ).toFloat( &ok_y ),
+                               atts.value( QLatin1String( "z" ) ).toFloat( &ok_z ) );
+        const bool surface = ( 0 == atts.value( QLatin1String( "surface" ) ).compare( QLatin1String( "true" ), Qt::CaseInsensitive ) );
+        float pressure = 0.f;
+        const bool referencePressure = atts.hasAttribute( QLatin1String( "pressure" ) );
+        if( referencePressure ) {
+            pressure = atts.value( QLatin1String( "pressure" ) ).toFloat( &ok_p );
         }
-        if( ok_x && ok_y && ok_z && ok_p && !junction->id().isNull() ) {
-            junctionMap.insert( junction->id(), m_ventNet.m_junction.count() );
-            m_ventNet.m_junction.append( junction );
-            return true;
+        if( !ok_x || !ok_y || !ok_z || !ok_p || !atts.hasAttribute( QLatin1String( "id" ) ) ) {
+            return false;
         }
-        delete junction;
-        return false;
-    }
 
-    bool addBranchFan( int branchId, const QStringList& fanId ) {
-        if( fanId.count() != 2 ) {
-            return false;   // bad formatting
+        const int j = m_ventNet.m_junction.append( atts.value( QLatin1String( "id" ) ), point, surface );
+        if( referencePressure ) {
+            m_ventNet.m_junction.setPressure( j, pressure );
         }
+        junctionMap.insert( m_ventNet.m_junction.id.ref( j ), j );
+        return true;
+    }
 
-        if( !fanId[0].isEmpty() ) {
+    /// fan="#id" refers to a fan definition of this file
+    bool addBranchFan( int branchId, const QStringRef& fanId ) {
+        if( !fanId.startsWith( QLatin1Char( '#' ) ) || fanId.indexOf( QLatin1Char( '#' ), 1 ) != -1 ) {
             return false;           // TODO:AW: external fan definitions
         }
+        const QStringRef id( fanId.mid( 1 ) );
 
         QList<class XMVentFan*>::const_iterator it;
         for( it = m_ventNet.m_fanDefinition.begin(); it != m_ventNet.m_fanDefinition.end(); it++ ) {
-            if( fanId[1] == (*it)->id() ) {
+            if( id == (*it)->id() ) {
                 m_ventNet.m_fanList.insert( branchId, *it );
                 return true;
             }
@@ -102,35 +129,30 @@ public:
         return false;
     }
 
-    bool addBranch( const QXmlAttributes& atts )
+    bool addBranch( const QXmlStreamAttributes& atts )
     {
-        QString from( atts.value("from") );
-        QString to( atts.value("to") );
+        QHash<QStringRef, int>::const_iterator from = junctionMap.constFind( atts.value( QLatin1String( "from" ) ) );
+        QHash<QStringRef, int>::const_iterator to = junctionMap.constFind( atts.value( QLatin1String( "to" ) ) );
         bool ok_r;
-        float r = atts.value("resistance").toFloat( &ok_r );
+        float r = atts.value( QLatin1String( "resistance" ) ).toFloat( &ok_r );
 
-        if( ok_r && junctionMap.contains(from) && junctionMap.contains(to) ) {
-            XMVentBranch* branch = new XMVentBranch( &m_ventNet );
-            branch->setResistance( r );
-            branch->setFromId( junctionMap[ atts.value("from") ] );
-            branch->setToId( junctionMap[ atts.value("to") ] );
-            branch->setId( atts.value("id") );
-            int branchId = m_ventNet.m_branch.count();
-            m_ventNet.m_branch.append( branch );
+        if( ok_r && from != junctionMap.constEnd() && to != junctionMap.constEnd() ) {
+            // a missing id is an empty one
+            int branchId = m_ventNet.m_branch.append( atts.value( QLatin1String( "id" ) ), from.value(), to.value(), r );
 
             // fixed flow branch
-            if( -1 != atts.index( "flow" ) ) {
+            if( atts.hasAttribute( QLatin1String( "flow" ) ) ) {
                 bool ok_flow;
-                float flow = atts.value("flow").toFloat(&ok_flow);
+                float flow = atts.value( QLatin1String( "flow" ) ).toFloat( &ok_flow );
                 if( !ok_flow ) {
                     return false;
                 }
-                m_ventNet.m_fixedFlow.insert( m_ventNet.m_branch.count() - 1, flow );
+                m_ventNet.m_fixedFlow.insert( branchId, flow );
             }
 
             // attach a fan
-            if( -1 != atts.index( "fan" ) ) {
-                return addBranchFan( branchId, atts.value( "fan" ).split( '#' ) );
+            if( atts.hasAttribute( QLatin1String( "fan" ) ) ) {
+                return addBranchFan( branchId, atts.value( QLatin1String( "fan" ) ) );
             }
             return true;
         }
@@ -138,38 +160,87 @@ public:
         return false;
     }
 
-    bool addFan( const QXmlAttributes& atts )
+    bool addFan( const QXmlStreamAttributes& atts )
     {
         XMVentFan* fan = new XMVentFan( &m_ventNet );
-        fan->setId( atts.value( "id" ) );           // TODO:AW: make sure this is unique
+        if( atts.hasAttribute( QLatin1String( "id" ) ) ) {
+            fan->setId( atts.value( QLatin1String( "id" ) ).toString() );     // TODO:AW: make sure this is unique
+        }
         m_ventNet.m_fanDefinition.append( fan );
-        if( -1 != atts.index("pressure") ) {
+        if( atts.hasAttribute( QLatin1String( "pressure" ) ) ) {
             bool ok_p;
-            float p = atts.value( "pressure" ).toFloat( &ok_p );
+            float p = atts.value( QLatin1String( "pressure" ) ).toFloat( &ok_p );
             if( !ok_p ) {
                 return false;
             }
             fan->setFixedPressure( p );
         }
+
+        // characteristic p = c0 + c1 Q + c2 Q^2 + ... between minFlow and maxFlow
+        if( atts.hasAttribute( QLatin1String( "polynomial" ) ) ) {
+            QVector<float> coefficient;
+            QVector<QStringRef> term = atts.value( QLatin1String( "polynomial" ) ).split( ' ', QString::SkipEmptyParts );
+            for( int i = 0; i < term.count(); i++ ) {
+                bool ok_c;
+                coefficient.append( term[i].toFloat( &ok_c ) );
+                if( !ok_c ) {
+                    return false;
+                }
+            }
+            bool ok_min, ok_max;
+            float minFlow = atts.value( QLatin1String( "minFlow" ) ).toFloat( &ok_min );
+            float maxFlow = atts.value( QLatin1String( "maxFlow" ) ).toFloat( &ok_max );
+            if( !ok_min || !ok_max || !fan->setPolynomial( coefficient, minFlow, maxFlow ) ) {
+                return false;
+            }
+        }
+        currentFan = fan;
         return true;
     }
 
-    bool executeScript()
+    /// one point of a tabulated fan characteristic
+    bool addFanPoint( const QXmlStreamAttributes& atts )
+    {
+        if( !currentFan ) {
+            return false;
+        }
+        bool ok_q, ok_p;
+        float q = atts.value( QLatin1String( "flow" ) ).toFloat( &ok_q );
+        float p = atts.value( QLatin1String( "pressure" ) ).toFloat( &ok_p );
+        if( !ok_q || !ok_p ) {
+            return false;
+        }
+        currentFan->addCurvePoint( q, p );
+        return true;
+    }
+
+    /// types for scripts, registered once per process
+    static bool registerScriptTypes()
+    {
+	// not available in Qt5.5?
+        //qmlRegisterType<XMVentFan>("com.mycompany.xmlmine", 1, 0, "XMVentFan");
+        //qmlRegisterType<QFile>("io.qt.core", 1, 0, "QFile");
+        return true;
+    }
+
+    bool executeScript( const QString& scriptCode )
     {
         QJSEngine myEngine;
-        static bool oneTime = true;
 
-        if( oneTime ) {
-	    // not available in Qt5.5?
-            //qmlRegisterType<XMVentFan>("com.mycompany.xmlmine", 1, 0, "XMVentFan");
-            //qmlRegisterType<QFile>("io.qt.core", 1, 0, "QFile");
-            oneTime = false;
-        }
+        // networks may be read on several threads at once; a local static is
+        // initialized by exactly one of them
+        static const bool registered = registerScriptTypes();
+        Q_UNUSED( registered );
 
         // TODO: import extensions in lieu of "qt.core"
 	// only available in Qt5.6
         //myEngine.installExtensions( QJSEngine::AllExtensions );
 
+        // the network and solver need not have a parent, e.g. on the stack in
+        // xmVent-cli; the engine must not delete them
+        QQmlEngine::setObjectOwnership( &m_ventNet, QQmlEngine::CppOwnership );
+        QQmlEngine::setObjectOwnership( &m_ventNet.m_solver, QQmlEngine::CppOwnership );
+
         QJSValue objectNet = myEngine.newQObject( &m_ventNet );
         myEngine.globalObject().setProperty( "net", objectNet );
 
@@ -185,61 +256,79 @@ public:
                 << ":" << r.toString();
             return false;
         } else {
-            qDebug() << "ECMA executed without error";
+            qCDebug( xmVentLog ) << "ECMA executed without error";
         }
 
         return true;
 
     }
 
-    bool startScript( const QXmlAttributes& atts )
+    /// the script is run when its element ends.  No elements are allowed
+    /// inside a script element; CDATA counts as character data.
+    bool readScript( const QXmlStreamAttributes& atts )
     {
-        if( atts.value("type") != "ECMAScript" ) {
+        if( atts.value( QLatin1String( "type" ) ) != QLatin1String( "ECMAScript" ) ) {
             return false;
         }
-        insideScript = true;
-        scriptCode = "";
-        return true;
-    }
-
-    bool characters( const QString& ch )
-    {
-        scriptCode.append( ch );
-        return true;
-    }
-
-    bool endScript()
-    {
-        executeScript();
-        insideScript = false;
+        const QString scriptCode = m_reader.readElementText( QXmlStreamReader::ErrorOnUnexpectedElement );
+        if( m_reader.hasError() ) {
+            return false;
+        }
+        executeScript( scriptCode );
         return true;
     }
 
-    bool startElement(const QString& /*namespaceURI*/, const QString& /*localName*/, const QString& qName, const QXmlAttributes& atts )
+    bool startElement()
     {
-        // no elements allowed inside a script element.  CDATA counts as character data not an element.
-        if( insideScript ) {
-            return false;
-        }
-
-        if(qName == "junction") {
+        const QStringRef name = m_reader.name();
+        const QXmlStreamAttributes atts = m_reader.attributes();
+        if( name == QLatin1String( "junction" ) ) {
             return addJunction( atts );
-        } else if( qName == "branch" ) {
+        } else if( name == QLatin1String( "branch" ) ) {
             return addBranch( atts );
-        } else if( qName == "fan" ) {
+        } else if( name == QLatin1String( "fan" ) ) {
             return addFan( atts );
-        } else if( qName == "script" ) {
-            return startScript( atts );
+        } else if( name == QLatin1String( "point" ) ) {
+            return addFanPoint( atts );
+        } else if( name == QLatin1String( "script" ) ) {
+            return readScript( atts );
         }
 
         // Ignore the unknown but continue to process XML
         return true;
     }
 
-    bool endElement(const QString& /*namespaceURI*/, const QString& /*localName*/, const QString& qName)
+    /// read the whole document, stopping at the first element not understood
+    bool parse( QIODevice* dev )
     {
-        if( qName == "script" ) {
-            return endScript();
+        if( !dev->isOpen() && !dev->open( QIODevice::ReadOnly ) ) {
+            return false;
+        }
+
+        int junctions, branches;
+        countElements( dev, junctions, branches );
+        m_ventNet.m_junction.reserve( junctions );
+        m_ventNet.m_branch.reserve( branches );
+        junctionMap.reserve( junctions );
+
+        m_reader.setDevice( dev );
+        while( !m_reader.atEnd() ) {
+            m_reader.readNext();
+            if( m_reader.isStartElement() ) {
+                if( !startElement() ) {
+                    if( !m_reader.hasError() ) {
+                        m_reader.raiseError( "Element not understood" );
+                    }
+                    break;
+                }
+            } else if( m_reader.isEndElement() && m_reader.name() == QLatin1String( "fan" ) ) {
+                currentFan = 0;
+            }
+        }
+
+        if( m_reader.hasError() ) {
+            qDebug() << "Network XML error at line" << m_reader.lineNumber() << ":" << m_reader.errorString();
+            return false;
         }
         return true;
     }
@@ -247,11 +336,8 @@ public:
     static void fromXml( QIODevice* dev, XMVentNetwork& ventNet )
     {
         // TODO:AW: error handle / return value
-        XMVentNetworkParser handler( ventNet );
-        QXmlInputSource source( dev );
-        QXmlSimpleReader reader;
-        reader.setContentHandler( &handler );
-        reader.parse( source ) ;
+        XMVentNetworkParser parser( ventNet );
+        parser.parse( dev );
     }
 
     static void fromXml( const QString& filename, XMVentNetwork& ventNet )
@@ -268,18 +354,17 @@ XMVentNetwork::XMVentNetwork( QObject *parent ) :
 }
 
 
+/// remove all network data.  Junctions, branches, their ids and the solver
+/// meshes are each a fixed number of buffers, freed at once; only the fans
+/// and the objects made by junction() and branch() are deleted one by one.
 void XMVentNetwork::clear()
 {
-    QVector<XMVentJunction*>::iterator itJunct;
-    for( itJunct = m_junction.begin(); itJunct != m_junction.end(); itJunct++ ) {
-        delete *itJunct;
-    }
+    qDeleteAll( m_junctionObject );
+    m_junctionObject.clear();
     m_junction.clear();
 
-    QVector<XMVentBranch*>::iterator itBranch;
-    for( itBranch = m_branch.begin(); itBranch != m_branch.end(); itBranch++ ) {
-        delete *itBranch;
-    }
+    qDeleteAll( m_branchObject );
+    m_branchObject.clear();
     m_branch.clear();
 
     QList<XMVentFan*>::iterator itFan;
@@ -295,6 +380,36 @@ void XMVentNetwork::clear()
 }
 
 
+/// deep copy of the junctions, branches, fans and fixed flows of other, with
+/// its solver settings but no solver state
+void XMVentNetwork::copyFrom( const XMVentNetwork& other )
+{
+    clear();
+
+    // the columns are shared until either network changes them
+    m_junction = other.m_junction;
+    m_branch = other.m_branch;
+
+    QList<XMVentFan*>::const_iterator itFan;
+    for( itFan = other.m_fanDefinition.begin(); itFan != other.m_fanDefinition.end(); itFan++ ) {
+        XMVentFan* fan = new XMVentFan( this );
+        fan->setId( (*itFan)->id() );
+        fan->setFixedPressure( (*itFan)->fixedPressure() );
+        fan->setCurve( (*itFan)->curve() );
+        m_fanDefinition.append( fan );
+    }
+
+    // branch fans refer to the copied definitions
+    QMap<int,XMVentFan*>::const_iterator itFanList;
+    for( itFanList = other.m_fanList.begin(); itFanList != other.m_fanList.end(); itFanList++ ) {
+        m_fanList.insert( itFanList.key(), m_fanDefinition[ other.m_fanDefinition.indexOf( itFanList.value() ) ] );
+    }
+
+    m_fixedFlow = other.m_fixedFlow;
+    m_solver.copySettings( other.m_solver );
+}
+
+
 void XMVentNetwork::fromXml( class QIODevice* dev )
 {
     clear();
@@ -319,11 +434,11 @@ void XMVentNetwork::getLimits( float& x0, float& y0, float& z0, float& x1, float
     y1 = -INFINITY;
     z0 = INFINITY;
     z1 = -INFINITY;
-    QVector<XMVentJunction*>::const_iterator itJunct;
-    for( itJunct = m_junction.begin(); itJunct != m_junction.end(); itJunct++ ) {
-        float x = (*itJunct)->point().x();
-        float y = (*itJunct)->point().y();
-        float z = (*itJunct)->point().z();
+    QVector<QVector3D>::const_iterator itPoint;
+    for( itPoint = m_junction.point.begin(); itPoint != m_junction.point.end(); itPoint++ ) {
+        float x = itPoint->x();
+        float y = itPoint->y();
+        float z = itPoint->z();
         if( x0 > x ) x0 = x;
         if( x1 < x ) x1 = x;
         if( y0 > y ) y0 = y;
@@ -348,14 +463,49 @@ XMVentFan* XMVentNetwork::getFanDefinition( const QString& id )
 
 int XMVentNetwork::findBranchIndex( const QString& id ) const
 {
-    QVector<class XMVentBranch*>::const_iterator it;
-    int i = 0;
-    for( it = m_branch.begin(); it != m_branch.end(); it++, i++ ) {
-        if( (*it)->id() == id ) {
-            return i;
-        }
+    return m_branch.id.indexOf( id );
+}
+
+
+int XMVentNetwork::junctionCount() const
+{
+    return m_junction.count();
+}
+
+
+int XMVentNetwork::branchCount() const
+{
+    return m_branch.count();
+}
+
+
+/// junction index as a QObject, owned by the network until clear(); 0 if
+/// there is no such junction
+XMVentJunction* XMVentNetwork::junction( int index )
+{
+    if( index < 0 || index >= m_junction.count() ) {
+        return 0;
+    }
+    XMVentJunction*& junction = m_junctionObject[ index ];
+    if( !junction ) {
+        junction = new XMVentJunction( m_junction, index, this );
+    }
+    return junction;
+}
+
+
+/// branch index as a QObject, owned by the network until clear(); 0 if there
+/// is no such branch
+XMVentBranch* XMVentNetwork::branch( int index )
+{
+    if( index < 0 || index >= m_branch.count() ) {
+        return 0;
+    }
+    XMVentBranch*& branch = m_branchObject[ index ];
+    if( !branch ) {
+        branch = new XMVentBranch( m_branch, index, this );
     }
-    return -1;
+    return branch;
 }
 
 
@@ -27,34 +27,51 @@
 #include "xmvent-global.h"
 
 #include <QObject>
+#include <QHash>
 #include <QMap>
+#include "junction.h"
+#include "branch.h"
 #include "solvehc.h"
 
 class XMVENTSHARED_EXPORT XMVentNetwork : public QObject
 {
     Q_OBJECT
+    Q_PROPERTY( int junctionCount READ junctionCount )
+    Q_PROPERTY( int branchCount READ branchCount )
+
+protected:
+    QHash<int, XMVentJunction*> m_junctionObject;   // made by junction(), until clear()
+    QHash<int, XMVentBranch*> m_branchObject;
 
 public:
-    // QVector is stored in adjacent memory and compatible with GL VBO
-    QVector<class XMVentJunction*> m_junction;
-    QVector<class XMVentBranch*> m_branch;
+    // junctions and branches are held in columns, not as one object each
+    XMVentJunctionTable m_junction;
+    XMVentBranchTable m_branch;
     QList<class XMVentFan*> m_fanDefinition;
     QMap<int,float> m_fixedFlow;  // (branchId, fixed flow)
     QMap<int,class XMVentFan*> m_fanList;
     XMVentSolveHC m_solver;
 
     void clear();
+    void copyFrom( const XMVentNetwork& other );
 
     explicit XMVentNetwork( QObject *parent = 0 );
 
     void fromXml( class QIODevice* dev );
     Q_INVOKABLE void fromXml( const QString& filename );
+    Q_INVOKABLE bool fromBinary( const QString& filename );
+    Q_INVOKABLE bool toBinary( const QString& filename, bool withMesh = true ) const;
 
     void getLimits( float& x0, float& y0, float& z0, float& x1, float& y1, float& z1 ) const;
 
     Q_INVOKABLE XMVentFan* getFanDefinition( const QString& id );
     Q_INVOKABLE int findBranchIndex( const QString& id ) const;
 
+    int junctionCount() const;
+    int branchCount() const;
+    Q_INVOKABLE XMVentJunction* junction( int index );
+    Q_INVOKABLE XMVentBranch* branch( int index );
+
 signals:
 
 public slots:
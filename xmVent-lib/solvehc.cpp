@@ -27,15 +27,29 @@
 #include "branch.h"
 #include "junction.h"
 #include "fan.h"
+#include "sweep.h"
 
 #include <QDebug>
 #include <QtAlgorithms>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QSaveFile>
 //#include <QScriptEngine>
 
+#include <algorithm>
 #include <cmath>
 #include <climits>
 using namespace std;
 
+Q_LOGGING_CATEGORY( xmVentLog, "xmvent" )
+
 // TODO:AW: presize arrays where possible
 
 
@@ -68,36 +82,96 @@ using namespace std;
  ******************************************************************************************/
 
 
-/// walk through all dependent branches and sum resistance
-float branchDependentWalk( int branchId,  const QVector<XMVentBranch*>& branches,
-                           const QMultiHash<int,XMVentSolveHCStep>& adj, QList<int>& branchAvoid )
+/// graph node of each junction: all surface junctions are one atmosphere node
+/// (the first of them), every other junction is its own node
+QVector<int> XMVentSolveHCGraph::junctionNodes( const XMVentNetwork* net )
+{
+    const int nJunctions = net->m_junction.count();
+    QVector<int> node( nJunctions );
+    int atmosphere = -1;
+    for( int j = 0; j < nJunctions; j++ ) {
+        node[ j ] = j;
+        if( net->m_junction.isSurface( j ) ) {
+            if( atmosphere < 0 ) {
+                atmosphere = j;
+            }
+            node[ j ] = atmosphere;
+        }
+    }
+
+    return node;
+}
+
+
+/// fill the compressed rows: count the steps leaving each junction, then place
+/// them in branch order
+void XMVentSolveHCAdjacency::build( const XMVentSolveHCGraph& g )
+{
+    const int nBranches = g.branchCount();
+    offset.fill( 0, g.nJunctions + 1 );
+    for( int b = 0; b < nBranches; b++ ) {
+        if( g.hasBranch( b ) ) {
+            offset[ g.branchFrom[b] + 1 ]++;
+            offset[ g.branchTo[b] + 1 ]++;
+        }
+    }
+    for( int j = 0; j < g.nJunctions; j++ ) {
+        offset[j+1] += offset[j];
+    }
+
+    step.resize( offset[ g.nJunctions ] );
+    QVector<int> next( offset );
+    for( int b = 0; b < nBranches; b++ ) {
+        if( !g.hasBranch( b ) ) {
+            continue;
+        }
+        // forward direction
+        XMVentSolveHCStep& forward = step[ next[ g.branchFrom[b] ]++ ];
+        forward.branchId = b;
+        forward.toNodeId = g.branchTo[b];
+        forward.direction = 1.f;
+
+        // reverse direction
+        XMVentSolveHCStep& reverse = step[ next[ g.branchTo[b] ]++ ];
+        reverse.branchId = b;
+        reverse.toNodeId = g.branchFrom[b];
+        reverse.direction = -1.f;
+    }
+}
+
+
+/// walk through all dependent branches and sum resistance, chain receives the
+/// branches of the independent super-branch
+float branchDependentWalk( int branchId, const XMVentSolveHCGraph& graph,
+                           const XMVentSolveHCAdjacency& adj, QVector<int>& chain )
 {
-    const XMVentBranch* branch = branches[branchId];
-    float resistance = branch->resistance();
+    float resistance = graph.branchResistance[ branchId ];
 
-    // avoid current branch
-    branchAvoid.append( branchId );
+    chain.clear();
+    chain.append( branchId );
 
     // calculate super-branch resistance
     for( int i=0; i<2; i++ ) {  // search from-node then to-node
         int lastBranchId = branchId;
-        int nodeId = ( i==0 ? branch->fromId() : branch->toId() );
+        int nodeId = ( i==0 ? graph.branchFrom[branchId] : graph.branchTo[branchId] );
 
         // step until end of independent super-branch
-        QList<XMVentSolveHCStep> step = adj.values( nodeId );
-        while( 2 == step.size() ) {
+        while( 2 == adj.degree( nodeId ) ) {
+            const XMVentSolveHCStep* step = adj.begin( nodeId );
             int stepId = ( step[0].branchId == lastBranchId ? 1 : 0 );
             int stepNodeId = step[stepId].toNodeId;
             int stepBranchId = step[stepId].branchId;
+            if( stepBranchId == branchId ) {
+                // isolated ring of degree-2 junctions, already complete
+                return resistance;
+            }
 
-            //Q_ASSERT( !branchAvoid.contains( stepBranchId ) );      // branch should not be in branchAvoid
-            resistance += branches[ stepBranchId ]->resistance();
-            branchAvoid.append( stepBranchId );
+            resistance += graph.branchResistance[ stepBranchId ];
+            chain.append( stepBranchId );
 
             // next step
             nodeId = stepNodeId;
             lastBranchId = stepBranchId;
-            step = adj.values( nodeId );
         }
     }
 
@@ -105,444 +179,3229 @@ float branchDependentWalk( int branchId,  const QVector<XMVentBranch*>& branches
 }
 
 
-/// create a list of high-resistance independent seed branches
-QList<int> branchPriority( const QVector<XMVentBranch*>& branches,
-                    const QMultiHash<int,XMVentSolveHCStep>& adj,
-                    QList<int> branchAvoid = QList<int>() )
+/// total resistance of the independent super-branch each branch belongs to
+QVector<float> branchPriority( const XMVentSolveHCGraph& graph,
+                               const XMVentSolveHCAdjacency& adj )
 {
-    // Insert sort into map (resistance, branchId)
-    QMultiMap<double, int> map;
-    QVector<class XMVentBranch*>::const_iterator it;
-    int branchId = 0;
-    for( it = branches.begin(); it != branches.end(); it++, branchId++ ) {
-        if( !branchAvoid.contains( branchId ) ) {
+    QVector<float> priority( graph.branchCount(), -1.f );
+    QVector<int> chain;
+    for( int branchId = 0; branchId < graph.branchCount(); branchId++ ) {
+        if( graph.hasBranch( branchId ) && priority[branchId] < 0.f ) {
             // calculate total resistance for all dependent branches
-            float resistance = branchDependentWalk( branchId, branches, adj, branchAvoid );
-
-            // add total branch to map
-            map.insertMulti( resistance, branchId );
-            //qDebug() << "Branch" << branchId << ": total resistance =" << resistance;
+            float resistance = branchDependentWalk( branchId, graph, adj, chain );
+            for( int k = 0; k < chain.count(); k++ ) {
+                priority[ chain[k] ] = resistance;
+            }
         }
     }
 
-    return map.values();
+    return priority;
 }
 
 
-/// create surface branches to complete network
-void addSurfaceJunctions( XMVentNetwork* net )
+/// one level of the depth first search in XMVentSolveHCTopology::analyze()
+struct XMVentTopologyFrame {
+    int junction;
+    int parentBranch;
+    int next;       ///< next step of the junction's row
+};
+
+
+/// Tarjan's bridge and biconnected component search, iterative so that long
+/// airways do not exhaust the call stack
+void XMVentSolveHCTopology::analyze( const XMVentSolveHCGraph& g, const XMVentSolveHCAdjacency& adj )
 {
-    bool first = true;
-    QVector<class XMVentJunction*>::const_iterator it;
-    int junctionId = 0;
-    int firstSurfaceId;
-    for( it = net->m_junction.begin(); it != net->m_junction.end(); it++, junctionId++ ) {
-        XMVentJunction* junction = *it;
-        if( junction->isSurface() ) { // test if surface junction
-            if( first ) {
-                firstSurfaceId = junctionId;
-                first = false;
-            } else { // add a surface branch
-                XMVentBranch* branch = new XMVentBranch( net );
-                branch->setResistance( 0. );
-                branch->setFromId( firstSurfaceId );
-                branch->setToId( junctionId );
-                net->m_branch.append( branch );
+    const int nBranches = g.branchCount();
+    branchBlock.fill( -1, nBranches );
+    bridge.fill( false, nBranches );
+    nBlocks = 0;
+    nBridges = 0;
+
+    QVector<int> discovered( g.nJunctions, -1 );
+    QVector<int> low( g.nJunctions, -1 );
+    QVector<int> branchStack;
+    QVector<XMVentTopologyFrame> stack;
+    int time = 0;
+
+    for( int b = 0; b < nBranches; b++ ) {
+        // a loop on one junction is a block of its own
+        if( g.hasBranch( b ) && g.branchFrom[b] == g.branchTo[b] ) {
+            branchBlock[ b ] = nBlocks++;
+        }
+    }
+
+    for( int start = 0; start < g.nJunctions; start++ ) {
+        if( discovered[start] >= 0 || 0 == adj.degree( start ) ) {
+            continue;
+        }
+        XMVentTopologyFrame frame;
+        frame.junction = start;
+        frame.parentBranch = -1;
+        frame.next = adj.offset[ start ];
+        discovered[ start ] = low[ start ] = time++;
+        stack.append( frame );
+
+        while( !stack.isEmpty() ) {
+            XMVentTopologyFrame& top = stack.last();
+            const int u = top.junction;
+            if( top.next < adj.offset[ u + 1 ] ) {
+                const XMVentSolveHCStep step = adj.step[ top.next++ ];
+                const int v = step.toNodeId;
+                if( step.branchId == top.parentBranch || v == u ) {
+                    continue;
+                }
+                if( discovered[v] < 0 ) {
+                    // tree edge
+                    branchStack.append( step.branchId );
+                    XMVentTopologyFrame child;
+                    child.junction = v;
+                    child.parentBranch = step.branchId;
+                    child.next = adj.offset[ v ];
+                    discovered[ v ] = low[ v ] = time++;
+                    stack.append( child );
+                } else if( discovered[v] < discovered[u] ) {
+                    // back edge, seen once from its lower end
+                    branchStack.append( step.branchId );
+                    low[ u ] = qMin( low[u], discovered[v] );
+                }
+                continue;
+            }
+
+            // all of u done, close its subtree at the parent
+            const int parentBranch = top.parentBranch;
+            stack.pop_back();
+            if( stack.isEmpty() ) {
+                continue;
+            }
+            const int p = stack.last().junction;
+            low[ p ] = qMin( low[p], low[u] );
+            if( low[u] >= discovered[p] ) {
+                if( low[u] > discovered[p] ) {
+                    bridge[ parentBranch ] = true;
+                    nBridges++;
+                    branchStack.pop_back();
+                    continue;
+                }
+                int e;
+                do {
+                    e = branchStack.last();
+                    branchStack.pop_back();
+                    branchBlock[ e ] = nBlocks;
+                } while( e != parentBranch );
+                nBlocks++;
             }
         }
     }
 }
 
 
-/// create an Adjacency map for nodes including branch numbers
-QMultiHash<int,XMVentSolveHCStep> nodeAdjacency( const QVector<class XMVentBranch*>& branches )
+/// disjoint sets of junctions for the spanning tree
+class XMVentUnionFind
 {
-    QMultiHash<int,XMVentSolveHCStep> nodeAdjacency;
+    QVector<int> m_parent;
+    QVector<int> m_rank;
 
-    int branchId;
-    XMVentSolveHCStep step;
-    QVector<XMVentBranch*>::ConstIterator itBranch;
-    for( itBranch = branches.begin(), branchId = 0; itBranch != branches.end(); itBranch++, branchId++ ) {
+public:
+    explicit XMVentUnionFind( int n ) : m_parent( n ), m_rank( n, 0 ) {
+        for( int i = 0; i < n; i++ ) {
+            m_parent[i] = i;
+        }
+    }
 
-        XMVentBranch* branch = *itBranch;
-        step.branchId = branchId;
+    int find( int i ) {
+        while( m_parent[i] != i ) {
+            m_parent[i] = m_parent[ m_parent[i] ];     // path halving
+            i = m_parent[i];
+        }
+        return i;
+    }
 
-        // forward direction
-        step.toNodeId = branch->toId();
-        step.direction = 1.f;
-        nodeAdjacency.insertMulti( branch->fromId(), step );
+    /// merge the sets of i and j, false if they are already the same set
+    bool unite( int i, int j ) {
+        i = find( i );
+        j = find( j );
+        if( i == j ) {
+            return false;
+        }
+        if( m_rank[i] < m_rank[j] ) {
+            qSwap( i, j );
+        }
+        m_parent[j] = i;
+        if( m_rank[i] == m_rank[j] ) {
+            m_rank[i]++;
+        }
+        return true;
+    }
+};
 
-        // reverse direction
-        step.toNodeId = branch->fromId();
-        step.direction = -1.f;
-        nodeAdjacency.insertMulti( branch->toId(), step );
+
+/// orders branches by super-branch resistance, then by own resistance
+struct XMVentBranchLess {
+    const QVector<float>& priority;
+    const QVector<float>& resistance;
+
+    XMVentBranchLess( const QVector<float>& p, const QVector<float>& r ) : priority( p ), resistance( r ) {}
+    bool operator()( int a, int b ) const {
+        if( priority[a] != priority[b] ) {
+            return priority[a] < priority[b];
+        }
+        if( resistance[a] != resistance[b] ) {
+            return resistance[a] < resistance[b];
+        }
+        return a < b;
+    }
+};
+
+
+/// orders chords by biconnected block
+struct XMVentBlockLess {
+    const QVector<int>& block;
+
+    explicit XMVentBlockLess( const QVector<int>& b ) : block( b ) {}
+    bool operator()( int a, int b ) const { return block[a] < block[b]; }
+};
+
+
+/// create network meshes.  A minimum resistance spanning tree is grown with
+/// Kruskal's algorithm; each branch left out of it (a chord) closes exactly one
+/// fundamental mesh through the tree.  High resistance branches end up as
+/// chords and so appear in a single mesh.  Fixed flow branches are always
+/// chords and their meshes are appended last, in m_fixedFlow order.
+void XMVentSolveHC::createMesh()
+{
+    m_meshList.clear();
+    QElapsedTimer timer;
+    timer.start();
+    XMVentSolveHCGraph g;
+    graph( g );
+    m_statistics.graphTime = timer.nsecsElapsed() * 1e-6;
+    const int nBranches = g.branchCount();
+    const int nJunctions = g.nJunctions;
+    const int* from = g.branchFrom.constData();
+    const int* to = g.branchTo.constData();
+    XMVentSolveHCAdjacency nodeAdj;
+    nodeAdj.build( g );
+
+    // bridges (dead ends, spurs) are in no mesh: leave them out and hold their flow at zero
+    XMVentSolveHCTopology topology;
+    topology.analyze( g, nodeAdj );
+    m_pruned.clear();
+    for( int b = 0; b < nBranches; b++ ) {
+        if( topology.bridge[b] ) {
+            if( m_ventNet->m_fixedFlow.contains( b ) ) {
+                qCDebug( xmVentLog ) << "Fixed flow branch" << b << "is in no closed path";
+                continue;
+            }
+            m_pruned.append( b );
+            g.branchFrom[ b ] = g.branchTo[ b ] = -1;
+        }
+    }
+    if( !m_pruned.isEmpty() ) {
+        nodeAdj.build( g );
+    }
+    qCDebug( xmVentLog ) << "Pruned" << m_pruned.count() << "branches in no mesh," << topology.nBlocks << "biconnected blocks";
+
+    // sort the candidate tree branches, fixed flows are never in the tree
+    QVector<float> priority = branchPriority( g, nodeAdj );
+    QVector<int> order;
+    order.reserve( nBranches );
+    for( int b = 0; b < nBranches; b++ ) {
+        if( g.hasBranch( b ) && !m_ventNet->m_fixedFlow.contains( b ) ) {
+            order.append( b );
+        }
+    }
+    std::sort( order.begin(), order.end(), XMVentBranchLess( priority, g.branchResistance ) );
+
+    // Kruskal: lowest resistance first, anything closing a loop is a chord
+    XMVentUnionFind junctionSet( nJunctions );
+    QVector<bool> inTree( nBranches, false );
+    QVector<int> chord;
+    for( int k = 0; k < order.count(); k++ ) {
+        const int b = order[k];
+        if( junctionSet.unite( from[b], to[b] ) ) {
+            inTree[b] = true;
+        } else {
+            chord.append( b );
+        }
+    }
+
+    // tree adjacency: the same rows with the chords and fixed flows hidden
+    XMVentSolveHCGraph tree( g );
+    for( int b = 0; b < nBranches; b++ ) {
+        if( !inTree[b] ) {
+            tree.branchFrom[ b ] = tree.branchTo[ b ] = -1;
+        }
+    }
+    XMVentSolveHCAdjacency treeAdj;
+    treeAdj.build( tree );
+
+    // root each tree of the forest: parent branch and depth of every junction
+    QVector<int> parentBranch( nJunctions, -1 );
+    QVector<int> depth( nJunctions, -1 );
+    QVector<int> queue;
+    queue.reserve( nJunctions );
+    for( int root = 0; root < nJunctions; root++ ) {
+        if( depth[root] >= 0 ) {
+            continue;
+        }
+        depth[root] = 0;
+        queue.append( root );
+        for( int q = queue.count() - 1; q < queue.count(); q++ ) {
+            const int j = queue[q];
+            for( const XMVentSolveHCStep* step = treeAdj.begin( j ); step != treeAdj.end( j ); step++ ) {
+                const int other = step->toNodeId;
+                if( depth[other] < 0 ) {
+                    depth[other] = depth[j] + 1;
+                    parentBranch[other] = step->branchId;
+                    queue.append( other );
+                }
+            }
+        }
     }
 
-    qDebug() << "nodeAdjacency";
-    QMultiHash<int,XMVentSolveHCStep>::ConstIterator itHash;
-    for( itHash = nodeAdjacency.begin(); itHash != nodeAdjacency.end(); itHash++ ) {
-        qDebug() << itHash.key() << "\t" << itHash.value().toNodeId << "\t" << itHash.value().branchId << "\t" << itHash.value().direction;
+    // balanced meshes block by block, in each the highest resistance chords
+    // first as the old seed order did.  A mesh never leaves its block.
+    QVector<int> blockChord( chord.count() );
+    for( int k = 0; k < chord.count(); k++ ) {
+        blockChord[ k ] = chord[ chord.count() - 1 - k ];
+    }
+    std::stable_sort( blockChord.begin(), blockChord.end(), XMVentBlockLess( topology.branchBlock ) );
+    m_program.blockOffset.fill( 0, 1 );
+    for( int k = 0; k < blockChord.count(); k++ ) {
+        if( k > 0 && topology.branchBlock[ blockChord[k] ] != topology.branchBlock[ blockChord[k-1] ] ) {
+            m_program.blockOffset.append( k );
+        }
+    }
+    m_program.blockOffset.append( blockChord.count() );
+
+    QList<int> seed = blockChord.toList();
+    seed.append( m_ventNet->m_fixedFlow.keys() );
+
+    // walk each chord forward, then through the tree back to its start
+    // the upward steps go straight into the mesh, the downward ones are found
+    // in reverse order
+    QVector<XMVentSolveHCStep> down;
+    QList<int>::const_iterator itSeed;
+    for( itSeed = seed.begin(); itSeed != seed.end(); itSeed++ ) {
+        const int c = *itSeed;
+        XMVentSolveHCStep step;
+        step.branchId = c;
+        step.direction = 1.f;
+        step.toNodeId = to[c];
+        m_meshList.append( step );
+
+        // climb from both ends to the common ancestor
+        int a = to[c];      // walked forward from here
+        int z = from[c];    // walked backward into here
+        down.clear();
+        if( junctionSet.find( a ) != junctionSet.find( z ) ) {
+            a = z;          // fixed flow branch without a return path
+        }
+        while( a != z ) {
+            if( depth[a] >= depth[z] ) {
+                const int t = parentBranch[a];
+                step.branchId = t;
+                step.direction = ( from[t] == a ? 1.f : -1.f );
+                step.toNodeId = ( from[t] == a ? to[t] : from[t] );
+                m_meshList.append( step );
+                a = step.toNodeId;
+            } else {
+                const int t = parentBranch[z];
+                step.branchId = t;
+                step.direction = ( to[t] == z ? 1.f : -1.f );
+                step.toNodeId = z;
+                down.append( step );
+                z = ( to[t] == z ? from[t] : to[t] );
+            }
+        }
+        for( int k = down.count() - 1; k >= 0; k-- ) {
+            m_meshList.append( down[k] );
+        }
+        m_meshList.closeMesh();
     }
 
-    return nodeAdjacency;
+    qCDebug( xmVentLog ) << "Spanning tree meshes:" << m_meshList.count() << "from" << nBranches << "branches";
 }
 
 
-/// return the coresponding index for a step with a given branchId
-int findBranchId( const QList<XMVentSolveHCStep>& stepList, int branchId )
+/// branch end points for the mesh search, after the series / parallel reduction if enabled
+void XMVentSolveHC::graph( XMVentSolveHCGraph& g ) const
 {
-    int stepId;
-    QList<XMVentSolveHCStep>::const_iterator itStep;
-    for( itStep = stepList.begin(), stepId = 0; itStep != stepList.end(); itStep++, stepId++ ) {
-        if( itStep->branchId == branchId ) {
-            return stepId;
-        }
+    if( m_reduction.isReduced() ) {
+        m_reduction.graph( g );
+        return;
+    }
+
+    const int nBranches = m_ventNet->m_branch.count();
+    const QVector<int> node = XMVentSolveHCGraph::junctionNodes( m_ventNet );
+    g.nJunctions = m_ventNet->m_junction.count();
+    g.branchFrom.resize( nBranches );
+    g.branchTo.resize( nBranches );
+    g.branchResistance.resize( nBranches );
+    const XMVentBranchTable& branch = m_ventNet->m_branch;
+    for( int b = 0; b < nBranches; b++ ) {
+        g.branchFrom[ b ] = node[ branch.from[b] ];
+        g.branchTo[ b ] = node[ branch.to[b] ];
+        g.branchResistance[ b ] = branch.resistance[ b ];
+    }
+}
+
+
+/// first word of a mesh cache file, "XMVM"
+static const quint32 meshCacheMagic = 0x584d564d;
+static const qint32 meshCacheVersion = 1;
+
+
+/// hash of what the meshes depend on apart from the resistances: the branch
+/// ends seen by the mesh search and the fixed flow branches
+QByteArray XMVentSolveHC::topologyKey() const
+{
+    XMVentSolveHCGraph g;
+    graph( g );
+
+    QCryptographicHash hash( QCryptographicHash::Sha1 );
+    const qint32 size[2] = { g.nJunctions, g.branchCount() };
+    hash.addData( reinterpret_cast<const char*>( size ), sizeof( size ) );
+    for( int b = 0; b < g.branchCount(); b++ ) {
+        const qint32 ends[2] = { g.branchFrom[b], g.branchTo[b] };
+        hash.addData( reinterpret_cast<const char*>( ends ), sizeof( ends ) );
+    }
+    QMap<int, float>::const_iterator itFixedFlow;
+    for( itFixedFlow = m_ventNet->m_fixedFlow.begin(); itFixedFlow != m_ventNet->m_fixedFlow.end(); itFixedFlow++ ) {
+        const qint32 b = itFixedFlow.key();
+        hash.addData( reinterpret_cast<const char*>( &b ), sizeof( b ) );
     }
 
-    // couldn't find branchId
-    return -1;
+    return hash.result();
 }
 
 
-/// walk network to find the smallest loop starting with startBranchId and avoiding branchAvoid.
-/// algorithm based on a LIFO stack instead of a recursive algorithm for efficiency
-QList<XMVentSolveHCStep> findSmallestClosedWalk( int startBranchId, const XMVentNetwork* net,
-    const QMultiHash<int,XMVentSolveHCStep>& adj, const QList<int> branchAvoid = QList<int>() )
+/// read a QVector<qint32> of at most maxCount entries, as written by operator<<
+static bool readMeshVector( QDataStream& in, QVector<qint32>& v, int maxCount )
 {
-    QList<XMVentSolveHCStep> branchList, smallestWalk;
-    QMap<int, int> nodeDistance;                // TODO: does this superseed the avoidBranch or otherwise?
+    quint32 n;
+    in >> n;
+    if( in.status() != QDataStream::Ok || n > quint32( maxCount ) ) {
+        return false;
+    }
+    v.resize( n );
+    for( quint32 i = 0; i < n; i++ ) {
+        in >> v[i];
+    }
+    return in.status() == QDataStream::Ok;
+}
 
-    // Seed the stack
-    QList<QList<XMVentSolveHCStep> > stack;
-    stack.append( adj.values( net->m_branch[ startBranchId ]->toId() ) );
-    XMVentSolveHCStep firstStep;
-    firstStep.branchId = startBranchId;
-    firstStep.direction = 1.f;
-    firstStep.toNodeId = net->m_branch[ startBranchId ]->toId();
-    branchList.append( firstStep );
-    const int nodeIdStart = net->m_branch[ startBranchId ]->fromId();
-    // TODO:AW: nodeDistance here?
 
-    // Process the stack
-    while( stack.count() > 0 ) {
-        if( stack.last().count() == 0 ) {
-            // step back in walk by droping last item from stack
-            stack.pop_back();
-            branchList.pop_back();
+/// read the meshes, pruned branches and blocks written by writeMesh(); false
+/// if they are not for this topology or not consistent
+bool XMVentSolveHC::readMesh( QDataStream& in )
+{
+    in.setVersion( QDataStream::Qt_5_5 );
+
+    const QByteArray key = topologyKey();
+    const int nBranches = m_ventNet->m_branch.count();
+    const int nFixed = m_ventNet->m_fixedFlow.count();
+    quint32 magic;
+    qint32 version, nMesh;
+    in >> magic >> version;
+    if( in.status() != QDataStream::Ok || magic != meshCacheMagic || version != meshCacheVersion ) {
+        return false;
+    }
+    QByteArray fileKey( key.size(), 0 );
+    in.readRawData( fileKey.data(), fileKey.size() );
+    in >> nMesh;
+    if( in.status() != QDataStream::Ok || fileKey != key || nMesh < nFixed ) {
+        return false;
+    }
 
-        } else {
-            // get next step information from stack
-            XMVentSolveHCStep step = stack.last().last();       // TODO:AW: rename pair to something useful
-            stack.last().pop_back();
-            //int nodeId = step.toNodeId;
-            //int branchId = step.branchId;
-
-            // skip branch if in branchAvoid
-            if( branchAvoid.contains( step.branchId ) ) {
-                continue;
+    // meshes as (branch, direction, end junction) steps
+    XMVentSolveHCMeshList meshList;
+    for( int i = 0; i < nMesh && in.status() == QDataStream::Ok; i++ ) {
+        qint32 nSteps;
+        in >> nSteps;
+        for( int k = 0; k < nSteps && in.status() == QDataStream::Ok; k++ ) {
+            qint32 branchId, toNodeId;
+            qint8 direction;
+            in >> branchId >> toNodeId >> direction;
+            if( branchId < 0 || branchId >= nBranches ) {
+                return false;
             }
+            XMVentSolveHCStep step;
+            step.branchId = branchId;
+            step.toNodeId = toNodeId;
+            step.direction = ( direction < 0 ? -1.f : 1.f );
+            meshList.append( step );
+        }
+        meshList.closeMesh();
+    }
+    QVector<qint32> blockOffset, pruned;
+    if( in.status() != QDataStream::Ok || !readMeshVector( in, blockOffset, nMesh + 1 )
+        || !readMeshVector( in, pruned, nBranches ) ) {
+        return false;
+    }
 
-            // skip branch if already used in branchList or in branchAvoid
-
-            if( -1 == findBranchId( branchList, step.branchId ) ) {
-                if( step.toNodeId == nodeIdStart ) {
-                    // loop detected
-                    smallestWalk = branchList;
-                    smallestWalk.append( step );
-                } else {
-                    // skip if we've already visited this point faster.
-                    if( nodeDistance.value( step.toNodeId, INT_MAX ) >= stack.count() ) {
-
-                        // do next step only if smaller walk is still possible
-                        if( smallestWalk.count() == 0 || (branchList.count()+2) < smallestWalk.count() ) {
-                            // append new stack level
-                            stack.append( adj.values( step.toNodeId ) );
-                            branchList.append( step );
-                            nodeDistance[ step.toNodeId ] = stack.count();
-                        }
-                    }
-                }
+    // the blocks split the balanced meshes, each pruned branch appears once
+    if( !blockOffset.isEmpty() ) {
+        if( blockOffset.first() != 0 || blockOffset.last() != nMesh - nFixed ) {
+            return false;
+        }
+        for( int b = 1; b < blockOffset.count(); b++ ) {
+            if( blockOffset[b] < blockOffset[b-1] ) {
+                return false;
             }
         }
     }
+    QVector<bool> isPruned( nBranches, false );
+    QVector<qint32>::const_iterator itPruned;
+    for( itPruned = pruned.begin(); itPruned != pruned.end(); itPruned++ ) {
+        if( *itPruned < 0 || *itPruned >= nBranches || isPruned[ *itPruned ] ) {
+            return false;
+        }
+        isPruned[ *itPruned ] = true;
+    }
+
+    // the fixed flow meshes start at their branches, in m_fixedFlow order
+    QMap<int, float>::const_iterator itFixedFlow = m_ventNet->m_fixedFlow.begin();
+    for( int i = nMesh - nFixed; i < nMesh; i++, itFixedFlow++ ) {
+        if( meshList.stepCount( i ) == 0 || meshList.begin( i )->branchId != itFixedFlow.key() ) {
+            return false;
+        }
+    }
 
-    return smallestWalk;
+    m_meshList = meshList;
+    m_program.blockOffset = blockOffset;
+    m_pruned = pruned;
+    return true;
 }
 
 
-/// create network meshes
-void XMVentSolveHC::createMesh()
+/// read the meshes saved by saveMesh(); false if there is no usable file for
+/// this topology
+bool XMVentSolveHC::loadMesh( const QString& fileName )
 {
-    m_meshList.empty();
-    QMultiHash<int,XMVentSolveHCStep> nodeAdj = nodeAdjacency( m_ventNet->m_branch );
+    QFile file( fileName );
+    if( !file.open( QIODevice::ReadOnly ) ) {
+        return false;
+    }
+    QDataStream in( &file );
+    if( !readMesh( in ) ) {
+        return false;
+    }
+    qCDebug( xmVentLog ) << "Meshes loaded from" << fileName << ":" << m_meshList.count() << "meshes";
+    return true;
+}
 
-    QList<int> branchFixedFlow = m_ventNet->m_fixedFlow.keys();
 
-    // Walk through all fixed flow branches
-    QList<int> branchAvoid;
-    QList<int>::const_iterator itBranchId;
-    for( itBranchId = branchFixedFlow.begin(); itBranchId != branchFixedFlow.end(); itBranchId++ ) {
-        branchDependentWalk( *itBranchId, m_ventNet->m_branch, nodeAdj, branchAvoid );
+/// write the meshes of the last createMesh() under the current topology key
+void XMVentSolveHC::writeMesh( QDataStream& out ) const
+{
+    out.setVersion( QDataStream::Qt_5_5 );
+
+    const QByteArray key = topologyKey();
+    out << meshCacheMagic << meshCacheVersion;
+    out.writeRawData( key.constData(), key.size() );
+    out << qint32( m_meshList.count() );
+    for( int i = 0; i < m_meshList.count(); i++ ) {
+        out << qint32( m_meshList.stepCount( i ) );
+        for( const XMVentSolveHCStep* step = m_meshList.begin( i ); step != m_meshList.end( i ); step++ ) {
+            out << qint32( step->branchId ) << qint32( step->toNodeId )
+                << qint8( step->direction < 0.f ? -1 : 1 );
+        }
     }
+    out << m_program.blockOffset << m_pruned;
+}
 
-    // create seed priority list
-    int nMeshes = m_ventNet->m_branch.count() - m_ventNet->m_junction.count() + 1;
-    int nMeshBalance = nMeshes - branchFixedFlow.count();
-    QList<int> branchList = branchPriority( m_ventNet->m_branch, nodeAdj, branchAvoid );
 
-    branchAvoid = branchFixedFlow;
-    for( int i = 0; i < nMeshes; i++ ) {
-        int branchId;
-        if( i < nMeshBalance ) {    // non-fixed flow meshes
-            branchId = branchList.last();
-        } else {    // fixed-flow meshes
-            branchId = branchFixedFlow[ i - nMeshBalance ];
-            // unblock branch
-            branchAvoid.removeAll( branchId );
-        }
+void XMVentSolveHC::saveMesh( const QString& fileName ) const
+{
+    QSaveFile file( fileName );
+    if( !file.open( QIODevice::WriteOnly ) ) {
+        qDebug() << "Cannot write mesh cache" << fileName;
+        return;
+    }
+    QDataStream out( &file );
+    writeMesh( out );
+
+    if( !file.commit() ) {
+        qDebug() << "Cannot write mesh cache" << fileName;
+    }
+}
 
-        // find shortest closed walk around graph
-        m_meshList.append( findSmallestClosedWalk( branchId, m_ventNet, nodeAdj, branchAvoid ) );
 
-        // remove all newly used branches in walk from branchList
-        QList<XMVentSolveHCStep>::const_iterator itStep;
-        for( itStep = m_meshList.last().begin(); itStep != m_meshList.last().end(); itStep++ ) {
-            branchList.removeAll( itStep->branchId );
-        }
+/// the meshes of the last initialize() in the mesh cache format, empty if
+/// there are none
+QByteArray XMVentSolveHC::meshData() const
+{
+    QByteArray data;
+    if( !m_meshList.isEmpty() ) {
+        QBuffer buffer( &data );
+        buffer.open( QIODevice::WriteOnly );
+        QDataStream out( &buffer );
+        writeMesh( out );
     }
+    return data;
+}
+
+
+/// meshes for the next initialize(), used instead of a mesh search if they
+/// were found for the topology the network has then.  They are only checked
+/// there, by readMesh(), since the topology key depends on the settings of
+/// that initialize().
+void XMVentSolveHC::setMeshData( const QByteArray& data )
+{
+    m_meshData = data;
 }
 
 
 void XMVentSolveHC::flowInitialize()
 {
+    QElapsedTimer timer;
+    timer.start();
+
     // create and initialize flow values to zero
-    m_flowList.empty();
-    int nBranches = m_ventNet->m_branch.count();
-    m_flowList.reserve( nBranches );
-    for( int i = 0; i < nBranches; i++ ) {
-        m_flowList.append( 0. );
-    }
+    m_flowList.fill( 0.f, m_ventNet->m_branch.count() );
+    float* flow = m_flowList.data();
 
     // initialize flows using mesh loops
-    int nMeshBalanced = m_meshList.count() - m_ventNet->m_fixedFlow.count();
+    const int* offset = m_program.meshOffset.constData();
+    const int* stepBranch = m_program.stepBranch.constData();
+    const qint8* stepDirection = m_program.stepDirection.constData();
     QMap<int, float>::const_iterator itFixedFlow = m_ventNet->m_fixedFlow.begin();
-    for( int i = 0; i < m_meshList.count(); i++ ) {
+    for( int i = 0; i < m_program.meshCount(); i++ ) {
         // initialize each branch with 1 or specified fixed flow if applicable
         float fixed = 1.;
-        int iFixedFlow = i - nMeshBalanced;
-        if( iFixedFlow >= 0 ) {
+        if( i >= m_program.nMeshBalanced ) {
             fixed = (itFixedFlow++).value();
         }
 
         // for all branches in mesh: flow[branch] += fixed * coeff[branch]
-        QList<XMVentSolveHCStep>::const_iterator itStep;
-        for( itStep = m_meshList[i].begin(); itStep != m_meshList[i].end(); itStep++ ) {
-            m_flowList[ itStep->branchId ] += fixed * itStep->direction;
+        for( int k = offset[i]; k < offset[i+1]; k++ ) {
+            flow[ stepBranch[k] ] += fixed * stepDirection[k];
         }
     }
+    m_statistics.flowInitializeTime = timer.nsecsElapsed() * 1e-6;
 }
 
 
-struct MeshAdjust {
-    float pressure;
-    float slope;
-};
-
-
-/// calculate mesh pressure imbalance and slope (dP/dQ) for correction
-MeshAdjust pressureAdjustBranch( const QList<float>& flow, const QList<XMVentSolveHCStep>& mesh,
-                                 const QVector<class XMVentBranch*>& branchList,
-                                 const QMap<int,class XMVentFan*>& fanList )
+XMVentSolveHCProgram::XMVentSolveHCProgram() : kernel( &XMVentMeshKernel::instance() ), reduction( 0 )
 {
-    MeshAdjust adj;
-    adj.pressure = 0.;
-    adj.slope = 0.;
+    clear();
+}
 
-    for( int j = 0; j < mesh.size(); j++ ) {    // for each branch in mesh
-        int branchId = mesh[ j ].branchId;
-        const XMVentBranch* branch = branchList[ branchId ];
-        float n = branch->n();
-        float q = mesh[ j ].direction * flow[ branchId ];    // signed flow relative to mesh direction ?
-        float rq = pow( fabs(q), n - 1.f) * branch->resistance();
-        adj.pressure += rq * q; // pressure += fsp + nvp
-        adj.slope += n * rq;   // pressure += slope(fsp) + slope(nvp)
 
-        // add fan static pressure
-        const XMVentFan* fan = fanList.value( branchId, 0 );
-        if( fan ) {
-            // TODO:AW: variable pressure fans
-            adj.pressure -= mesh[ j ].direction * fan->fixedPressure();
-        }
+/// split the mesh steps into branch and direction arrays
+void XMVentSolveHCProgram::compile( const XMVentSolveHCMeshList& meshList, int nFixedFlow )
+{
+    const int nSteps = meshList.step.count();
+    nMeshBalanced = meshList.count() - nFixedFlow;
+    meshOffset = meshList.offset;
+    stepBranch.resize( nSteps );
+    stepDirection.resize( nSteps );
+    for( int k = 0; k < nSteps; k++ ) {
+        stepBranch[ k ] = meshList.step[k].branchId;
+        stepDirection[ k ] = ( meshList.step[k].direction < 0.f ? -1 : 1 );
     }
 
-    return adj;
+    stepResistance.fill( 0.f, nSteps );
+    stepN.fill( 2.f, nSteps );
+    stepFanPressure.fill( 0.f, nSteps );
+    meshLawOffset.resize( 2 * meshCount() );
+    for( int i = 0; i < meshCount(); i++ ) {
+        meshLawOffset[ 2*i ] = meshLawOffset[ 2*i + 1 ] = meshOffset[ i + 1 ];
+    }
 }
 
 
-/// solve for next Hardy-Cross iteration step
-// TODO:AW: test over relaxation 1 < lambda < 2 to accelerate convergence
-float ventSolveHCIterate( QList<float>& flow, const QVector<class XMVentBranch*>& branchList,
-                          const QList<QList<XMVentSolveHCStep> >& meshList, const QMap<int,class XMVentFan*>& fanList,
-                          int nMeshBalanced, float lambda )
+/// branch -> balanced mesh incidence, the meshes of branch b are
+/// branchMesh[ branchMeshOffset[b], branchMeshOffset[b+1] )
+void XMVentSolveHCProgram::incidence()
 {
-    float meshCorrection = 0;
+    const int nMesh = nMeshBalanced;
+    const int nSteps = meshOffset[ nMesh ];
+    int nBranches = 0;
+    for( int k = 0; k < nSteps; k++ ) {
+        nBranches = qMax( nBranches, stepBranch[k] + 1 );
+    }
 
-    for( int i = 0; i < nMeshBalanced; i++ ) {  // for each mesh, but not fixed-flow meshes
-        QList<XMVentSolveHCStep> mesh = meshList[i];
-        // calculate correction
-        MeshAdjust adjust = pressureAdjustBranch( flow, mesh, branchList, fanList );
+    branchMeshOffset.fill( 0, nBranches + 1 );
+    for( int k = 0; k < nSteps; k++ ) {
+        branchMeshOffset[ stepBranch[k] + 1 ]++;
+    }
+    for( int b = 0; b < nBranches; b++ ) {
+        branchMeshOffset[ b + 1 ] += branchMeshOffset[ b ];
+    }
+    branchMesh.resize( nSteps );
+    QVector<int> next( branchMeshOffset );
+    for( int i = 0; i < nMesh; i++ ) {
+        for( int k = meshOffset[i]; k < meshOffset[i+1]; k++ ) {
+            branchMesh[ next[ stepBranch[k] ]++ ] = i;
+        }
+    }
+}
 
-        meshCorrection += abs( adjust.pressure );
 
-        // apply correction
-        if( adjust.slope != 0. ) { // TODO:AW: is this okay or should it be a fuzzy test for "too small"?
-            float meshFlowCorrection = - adjust.pressure / adjust.slope * lambda;
-            for( int j = 0; j < mesh.size(); j++ ) {
-                // correction adjusted for branch direction
-                flow[ mesh[ j ].branchId ] += mesh[ j ].direction * meshFlowCorrection;
+/// greedy coloring of the balanced meshes so that no two meshes of one color
+/// share a branch.  Meshes are visited in index order, so the classes only
+/// depend on the mesh list.
+void XMVentSolveHCProgram::color()
+{
+    const int nMesh = nMeshBalanced;
+    if( branchMeshOffset.isEmpty() ) {
+        incidence();
+    }
+    const int* branchOffset = branchMeshOffset.constData();
+
+    QVector<int> meshColor( nMesh, -1 );
+    QVector<int> forbidden;          // colour -> last mesh it was forbidden for
+    int nColor = 0;
+    for( int i = 0; i < nMesh; i++ ) {
+        for( int k = meshOffset[i]; k < meshOffset[i+1]; k++ ) {
+            const int b = stepBranch[ k ];
+            for( int p = branchOffset[b]; p < branchOffset[b+1]; p++ ) {
+                int c = meshColor[ branchMesh[p] ];
+                if( c >= 0 ) {
+                    forbidden[ c ] = i;
+                }
             }
         }
+        int c = 0;
+        while( c < nColor && forbidden[c] == i ) {
+            c++;
+        }
+        if( c == nColor ) {
+            forbidden.append( -1 );
+            nColor++;
+        }
+        meshColor[ i ] = c;
     }
 
-    return meshCorrection;
+    colorOffset.fill( 0, nColor + 1 );
+    for( int i = 0; i < nMesh; i++ ) {
+        colorOffset[ meshColor[i] + 1 ]++;
+    }
+    for( int c = 0; c < nColor; c++ ) {
+        colorOffset[ c + 1 ] += colorOffset[ c ];
+    }
+    colorMesh.resize( nMesh );
+    QVector<int> next( colorOffset );
+    for( int i = 0; i < nMesh; i++ ) {
+        colorMesh[ next[ meshColor[i] ]++ ] = i;
+    }
 }
 
 
-/// Hardy-Cross iterative solution
-/// tolerance - sum of absolute mesh pressure error in pascals?
-bool XMVentSolveHC::solve( float meshCorrectionTolerance, int iterationMax, float lambda )
+/// compiled characteristic of each fan definition, empty for a fixed pressure
+/// fan.  The fans keep them compiled, so this only shares their tables.
+static void xmVentFanCurves( const XMVentNetwork* net, QVector<XMVentFanCurve>& fanCurve )
 {
-    // initialize if it has not already been done
-    if( m_meshList.count() == 0 ) {
-        initialize();
+    fanCurve.resize( net->m_fanDefinition.count() );
+    for( int f = 0; f < net->m_fanDefinition.count(); f++ ) {
+        fanCurve[ f ] = net->m_fanDefinition[f]->compiledCurve();
     }
+}
 
-    const int nMeshBalanced = m_meshList.count() - m_ventNet->m_fixedFlow.count();
-
-    // Iterate to balance the network until tolerance achieved or maximum iterations
-    float meshCorrection = +INFINITY;
-    int i;
-    for( i = 0; (i < iterationMax) && (meshCorrection > meshCorrectionTolerance) ; i++ ) {
-        meshCorrection = ventSolveHCIterate( m_flowList, m_ventNet->m_branch, m_meshList,
-                                             m_ventNet->m_fanList, nMeshBalanced, lambda );
 
-        //qDebug() << "Iteration" << i << "meshCorrection:" << meshCorrection;
+/// copy current branch resistance, exponent and fan pressure into the step arrays
+void XMVentSolveHCProgram::gather( const XMVentNetwork* net )
+{
+    const int nSteps = stepCount();
+    float* resistance = stepResistance.data();
+    float* n = stepN.data();
+    float* fanPressure = stepFanPressure.data();
+
+    const float* branchResistance = net->m_branch.resistance.constData();
+    const float* branchN = net->m_branch.n.constData();
+    for( int k = 0; k < nSteps; k++ ) {
+        resistance[ k ] = branchResistance[ stepBranch[k] ];
+        n[ k ] = branchN[ stepBranch[k] ];
+        fanPressure[ k ] = 0.f;
     }
 
-    if( i != iterationMax ) {
-        qDebug() << "Solution found after iteration" << i;
-    } else {
-        qDebug() << "Did not achieve convergence criteria after iteration" << i;
+    // representatives of reduced branches carry the equivalent values
+    if( reduction ) {
+        for( int k = 0; k < nSteps; k++ ) {
+            const int r = reduction->branchRoot[ stepBranch[k] ];
+            if( r >= 0 ) {
+                resistance[ k ] = reduction->resistance[ reduction->root[r] ];
+                n[ k ] = reduction->n[ reduction->root[r] ];
+            }
+        }
     }
 
-    return i == iterationMax;
-}
-
-
-/// Hardy-Cross iterative solution with Aitken convergence acceleration
-/// tolerance - sum of absolute pressure error in pascals?
-/*void ventSolveHC_Aitken( QList<float>& flow, const XMVentNetwork* net, const QList<QList<int> >& meshList,
-                  const QList<QList<float> >& meshCoeff, float meshCorrectionTolerance = 0.1,
-                  int iterationMax = 5000 )
-{
-    const int nMeshBalanced = meshList.count() - net->fixedFlow.count();
+    // fans are sparse; look each one up once rather than once per step
+    xmVentFanCurves( net, fanCurve );
+    bool anyCurve = false;
+    if( !net->m_fanList.isEmpty() ) {
+        QMap<int,class XMVentFan*>::const_iterator itFan;
+        for( int k = 0; k < nSteps; k++ ) {
+            itFan = net->m_fanList.find( stepBranch[k] );
+            if( itFan != net->m_fanList.end() ) {
+                if( itFan.value()->hasCurve() ) {
+                    anyCurve = true;        // evaluated at the flow during the iteration
+                } else {
+                    fanPressure[ k ] = stepDirection[ k ] * itFan.value()->fixedPressure();
+                }
+            }
+        }
+    }
 
-    QList<float> flowSet[3];
+    // order the steps of each mesh square law first, then laminar, then the rest
+    // so the kernels get uniform runs.  The order of a mesh's steps is arbitrary.
+    const int nMesh = meshCount();
+    meshLawOffset.resize( 2 * nMesh );
+    QVector<int> order;
+    for( int i = 0; i < nMesh; i++ ) {
+        const int begin = meshOffset[ i ];
+        const int end = meshOffset[ i + 1 ];
+        int nSquare = 0, nLinear = 0;
+        bool sorted = true;
+        int lastLaw = 0;
+        for( int k = begin; k < end; k++ ) {
+            int law = ( n[k] == 2.f ? 0 : ( n[k] == 1.f ? 1 : 2 ) );
+            nSquare += ( law == 0 );
+            nLinear += ( law == 1 );
+            sorted = sorted && ( law >= lastLaw );
+            lastLaw = law;
+        }
+        meshLawOffset[ 2*i ] = begin + nSquare;
+        meshLawOffset[ 2*i + 1 ] = begin + nSquare + nLinear;
+        if( sorted ) {
+            continue;
+        }
 
-    // Iterate to balance the network until tolerance achieved or maximum iterations
-    int i;
-    float meshCorrection = +INFINITY;
-    for( i = 0; (i < iterationMax) && (meshCorrection > meshCorrectionTolerance) ; i++ ) {
-        QList<float>& f0( flowSet[ i % 3 ] );
-        QList<float>& f1( flowSet[ ( i + 1 ) % 3 ] );
-        QList<float>& f2( flowSet[ ( i + 2 ) % 3 ] );
-
-        // set current working flow to last (or initial) flow vector
-        f0 = (i == 0) ? flow : f2;
-
-        meshCorrection = ventSolveHCIterate( f0, net, meshList, meshCoeff, nMeshBalanced );
-
-        qDebug() << "Iteration" << i << "flow:" << f0;
-
-        // convergence acceleration using Aitken's delta-squared process
-        if( i > 1 ) {
-            for( int j = 0; j < f0.count(); j++ ) {
-                // (f0*f1-f2*f2)/(f0-2*f2+f1)
-                float denom = f0[j] - 2.*f2[j] + f1[j];
-                if( fabs(denom) > 1e-10 ) {
-                    f0[j] = (f0[j]*f1[j] - f2[j]*f2[j]) / denom;
+        order.clear();
+        for( int law = 0; law < 3; law++ ) {
+            for( int k = begin; k < end; k++ ) {
+                if( ( n[k] == 2.f ? 0 : ( n[k] == 1.f ? 1 : 2 ) ) == law ) {
+                    order.append( k );
                 }
             }
-            qDebug() << "Aitken   " << i << "flow:" << f0;
         }
-
+        QVector<int> branch( end - begin );
+        QVector<qint8> direction( end - begin );
+        QVector<float> r( end - begin ), exponent( end - begin ), fan( end - begin );
+        for( int j = 0; j < order.count(); j++ ) {
+            branch[ j ] = stepBranch[ order[j] ];
+            direction[ j ] = stepDirection[ order[j] ];
+            r[ j ] = resistance[ order[j] ];
+            exponent[ j ] = n[ order[j] ];
+            fan[ j ] = fanPressure[ order[j] ];
+        }
+        for( int j = 0; j < order.count(); j++ ) {
+            stepBranch[ begin + j ] = branch[ j ];
+            stepDirection[ begin + j ] = direction[ j ];
+            resistance[ begin + j ] = r[ j ];
+            n[ begin + j ] = exponent[ j ];
+            fanPressure[ begin + j ] = fan[ j ];
+        }
     }
 
-    flow = flowSet[ --i % 3 ];
-}//*/
-
+    // curve fan steps of each mesh, after the steps found their final place
+    meshCurveOffset.clear();
+    curveStep.clear();
+    curveFan.clear();
+    if( anyCurve ) {
+        meshCurveOffset.resize( nMesh + 1 );
+        meshCurveOffset[ 0 ] = 0;
+        for( int i = 0; i < nMesh; i++ ) {
+            for( int k = meshOffset[i]; k < meshOffset[i+1]; k++ ) {
+                const XMVentFan* fan = net->m_fanList.value( stepBranch[k] );
+                if( fan && fan->hasCurve() ) {
+                    curveStep.append( k );
+                    curveFan.append( net->m_fanDefinition.indexOf( const_cast<XMVentFan*>( fan ) ) );
+                }
+            }
+            meshCurveOffset[ i + 1 ] = curveStep.count();
+        }
+    }
+}
 
 
-/// Ventilation Solver valid so long as mesh does not change.
-XMVentSolveHC::XMVentSolveHC( QObject* parent, XMVentNetwork* ventNet ) : QObject( parent ), m_ventNet( ventNet )
+XMVentMeshSteps XMVentSolveHCProgram::steps() const
 {
+    XMVentMeshSteps steps;
+    steps.branch = stepBranch.constData();
+    steps.direction = stepDirection.constData();
+    steps.resistance = stepResistance.constData();
+    steps.n = stepN.constData();
+    steps.fanPressure = stepFanPressure.constData();
+    return steps;
 }
 
 
-void XMVentSolveHC::initialize()
+void XMVentSolveHCProgram::clear()
 {
-    // reset all structures
-    m_meshList.empty();
-    m_flowList.empty();
+    nMeshBalanced = 0;
+    meshOffset.fill( 0, 1 );
+    stepBranch.clear();
+    stepDirection.clear();
+    stepResistance.clear();
+    stepN.clear();
+    stepFanPressure.clear();
+    meshLawOffset.clear();
+    fanCurve.clear();
+    meshCurveOffset.clear();
+    curveStep.clear();
+    curveFan.clear();
+    branchMeshOffset.clear();
+    branchMesh.clear();
+    blockOffset.clear();
+    colorOffset.clear();
+    colorMesh.clear();
+}
 
-    // add surface junctions, just like the function name suggests
-    // TODO:AW: delete old surface junctions?
-    addSurfaceJunctions( m_ventNet );
 
-    // find mesh and mesh direction coefficients
-    createMesh();
+/// collapse series chains and parallel groups of plain branches into composites
+void XMVentSolveHCReduction::build( const XMVentNetwork* net )
+{
+    clear();
+    nBranches = net->m_branch.count();
+    nJunctions = net->m_junction.count();
+    const QVector<int> node = XMVentSolveHCGraph::junctionNodes( net );
+
+    // items still standing in the reduced network, with their incident junctions
+    QVector<float> itemN( nBranches );
+    QVector<bool> itemFree( nBranches );     // may be merged
+    QVector<bool> alive( nBranches, true );
+    QVector<QVector<int> > incident( nJunctions );
+    itemFrom.resize( nBranches );
+    itemTo.resize( nBranches );
+    const XMVentBranchTable& branch = net->m_branch;
+    for( int b = 0; b < nBranches; b++ ) {
+        itemFrom[ b ] = node[ branch.from[b] ];
+        itemTo[ b ] = node[ branch.to[b] ];
+        itemN[ b ] = branch.n[ b ];
+        itemFree[ b ] = !net->m_fanList.contains( b ) && !net->m_fixedFlow.contains( b );
+        incident[ itemFrom[b] ].append( b );
+        if( itemTo[b] != itemFrom[b] ) {
+            incident[ itemTo[b] ].append( b );
+        }
+    }
 
-    // initialize flow
-    flowInitialize();
-    qDebug() << "Initialized flow:" << m_flowList;
-}
+    QVector<int> pending;               // junctions to test for a series merge
+    for( int j = 0; j < nJunctions; j++ ) {
+        pending.append( j );
+    }
 
+    bool merged = true;
+    while( merged ) {
+        merged = false;
+
+        // series: a junction joining exactly two free items
+        for( int p = 0; p < pending.count(); p++ ) {
+            const int j = pending[p];
+            QVector<int>& inc = incident[ j ];
+            for( int k = inc.count() - 1; k >= 0; k-- ) {
+                if( !alive[ inc[k] ] ) {
+                    inc.remove( k );
+                }
+            }
+            if( inc.count() != 2 ) {
+                continue;
+            }
+            const int e1 = inc[0], e2 = inc[1];
+            if( !itemFree[e1] || !itemFree[e2] || itemN[e1] != itemN[e2]
+                || itemFrom[e1] == itemTo[e1] || itemFrom[e2] == itemTo[e2] ) {
+                continue;
+            }
 
-QVariantList XMVentSolveHC::getFlow() const
-{
-    QVariantList r;
+            const int a = ( itemFrom[e1] == j ? itemTo[e1] : itemFrom[e1] );
+            const int c = ( itemFrom[e2] == j ? itemTo[e2] : itemFrom[e2] );
+            const int item = nBranches + kind.count();
+            kind.append( Series );
+            childOffset.append( child.count() + 2 );
+            child.append( e1 );
+            childSign.append( itemFrom[e1] == a ? 1 : -1 );
+            child.append( e2 );
+            childSign.append( itemFrom[e2] == j ? 1 : -1 );
+            itemFrom.append( a );
+            itemTo.append( c );
+            itemN.append( itemN[e1] );
+            itemFree.append( true );
+            alive[ e1 ] = false;
+            alive[ e2 ] = false;
+            alive.append( true );
+            inc.clear();
+            incident[ a ].append( item );
+            if( c != a ) {
+                incident[ c ].append( item );
+            }
+            merged = true;
+        }
+        pending.clear();
+
+        // parallel: free items with the same end points and n
+        QHash<qint64, int> first;           // end point pair -> first item
+        const int nItem = alive.count();
+        QVector<QVector<int> > group;
+        QVector<int> groupOf( nItem, -1 );
+        for( int e = 0; e < nItem; e++ ) {
+            if( !alive[e] || !itemFree[e] || itemFrom[e] == itemTo[e] ) {
+                continue;
+            }
+            const qint64 key = ( qint64( qMin( itemFrom[e], itemTo[e] ) ) << 32 ) | qMax( itemFrom[e], itemTo[e] );
+            QHash<qint64, int>::iterator it = first.find( key );
+            if( it == first.end() ) {
+                first.insert( key, e );
+            } else if( itemN[ it.value() ] == itemN[e] ) {
+                if( groupOf[ it.value() ] < 0 ) {
+                    groupOf[ it.value() ] = group.count();
+                    group.append( QVector<int>() << it.value() );
+                }
+                group[ groupOf[ it.value() ] ].append( e );
+            }
+        }
 
-    // Available in Qt5.6
-    // QList<float>::reverse_iterator it;
+        for( int g = 0; g < group.count(); g++ ) {
+            const QVector<int>& members = group[ g ];
+            const int u = itemFrom[ members[0] ];
+            const int v = itemTo[ members[0] ];
+            const int item = nBranches + kind.count();
+            kind.append( Parallel );
+            for( int k = 0; k < members.count(); k++ ) {
+                child.append( members[k] );
+                childSign.append( itemFrom[ members[k] ] == u ? 1 : -1 );
+                alive[ members[k] ] = false;
+            }
+            childOffset.append( child.count() );
+            itemFrom.append( u );
+            itemTo.append( v );
+            itemN.append( itemN[ members[0] ] );
+            itemFree.append( true );
+            alive.append( true );
+            incident[ u ].append( item );
+            incident[ v ].append( item );
+            pending.append( u );
+            pending.append( v );
+            merged = true;
+        }
+    }
 
-    for( int i = m_flowList.size()-1; i>=0; i-- ) {
-        r.append( m_flowList[i] );
+    // composites still standing are solved through their first branch
+    branchRoot.fill( -1, nBranches );
+    for( int c = 0; c < kind.count(); c++ ) {
+        if( alive[ nBranches + c ] ) {
+            int item = nBranches + c;
+            while( item >= nBranches ) {
+                item = child[ childOffset[ item - nBranches ] ];
+            }
+            branchRoot[ item ] = root.count();
+            root.append( c );
+            rootBranch.append( item );
+        }
     }
 
-    return r;
+    resistance.resize( kind.count() );
+    n.resize( kind.count() );
+    branchResistance.resize( nBranches );
+    rootFlow.fill( 0.f, root.count() );
+
+    qCDebug( xmVentLog ) << "Reduced" << nBranches << "branches to" << nBranches - hiddenCount()
+             << "with" << kind.count() << "series / parallel composites";
 }
 
 
-void XMVentSolveHC::setFlow( const QVariantList& flow )
+/// equivalent resistance and n of every composite.  Returns false if a
+/// reduced branch gained a fan or fixed flow or no longer shares n.
+bool XMVentSolveHCReduction::evaluate( const XMVentNetwork* net )
 {
-    QList<float> r;
+    if( net->m_branch.count() != nBranches ) {
+        return false;
+    }
+
+    bool valid = true;
+    branchResistance = net->m_branch.resistance;
+    for( int c = 0; c < kind.count(); c++ ) {
+        double sum = 0.;
+        float childN = -1.f;
+        bool shorted = false;
+        for( int k = childOffset[c]; k < childOffset[c+1]; k++ ) {
+            const int item = child[ k ];
+            float r, itemN;
+            if( item < nBranches ) {
+                r = net->m_branch.resistance[ item ];
+                itemN = net->m_branch.n[ item ];
+                valid = valid && !net->m_fanList.contains( item ) && !net->m_fixedFlow.contains( item );
+            } else {
+                r = resistance[ item - nBranches ];
+                itemN = n[ item - nBranches ];
+            }
+            valid = valid && ( childN < 0.f || itemN == childN );
+            childN = itemN;
+
+            if( kind[c] == Series ) {
+                sum += r;
+            } else if( r == 0.f ) {
+                shorted = true;
+            } else {
+                sum += pow( double( r ), -1. / itemN );
+            }
+        }
+
+        n[ c ] = childN;
+        if( kind[c] == Series ) {
+            resistance[ c ] = sum;
+        } else {
+            resistance[ c ] = ( shorted ? 0. : pow( sum, -double( childN ) ) );
+        }
+    }
+
+    return valid;
+}
+
+
+/// end points of the reduced network, branches inside a composite other than
+/// its representative are hidden
+void XMVentSolveHCReduction::graph( XMVentSolveHCGraph& g ) const
+{
+    g.nJunctions = nJunctions;
+    g.branchFrom.fill( -1, nBranches );
+    g.branchTo.fill( -1, nBranches );
+    g.branchResistance.resize( nBranches );
+
+    // start from every branch, then hide the members of the composites
+    for( int b = 0; b < nBranches; b++ ) {
+        g.branchFrom[ b ] = itemFrom[ b ];
+        g.branchTo[ b ] = itemTo[ b ];
+        g.branchResistance[ b ] = branchResistance[ b ];
+    }
+    for( int k = 0; k < child.count(); k++ ) {
+        if( child[k] < nBranches ) {
+            g.branchFrom[ child[k] ] = -1;
+            g.branchTo[ child[k] ] = -1;
+        }
+    }
+
+    for( int r = 0; r < root.count(); r++ ) {
+        const int item = nBranches + root[ r ];
+        g.branchFrom[ rootBranch[r] ] = itemFrom[ item ];
+        g.branchTo[ rootBranch[r] ] = itemTo[ item ];
+        g.branchResistance[ rootBranch[r] ] = resistance[ root[r] ];
+    }
+}
+
+
+/// replace each representative flow by the flow of its composite
+void XMVentSolveHCReduction::contract( float* flow ) const
+{
+    // unchanged since the last expand(): restore the exact composite flows
+    if( expandedFlow.count() == nBranches ) {
+        bool unchanged = true;
+        for( int b = 0; b < nBranches && unchanged; b++ ) {
+            unchanged = ( flow[b] == expandedFlow[b] );
+        }
+        if( unchanged ) {
+            for( int r = 0; r < root.count(); r++ ) {
+                flow[ rootBranch[r] ] = rootFlow[ r ];
+            }
+            return;
+        }
+    }
+
+    QVector<double> itemFlow( kind.count() );
+    for( int c = 0; c < kind.count(); c++ ) {
+        double q = 0.;
+        const int kEnd = ( kind[c] == Series ? childOffset[c] + 1 : childOffset[c+1] );
+        for( int k = childOffset[c]; k < kEnd; k++ ) {
+            const int item = child[ k ];
+            q += childSign[ k ] * ( item < nBranches ? double( flow[item] ) : itemFlow[ item - nBranches ] );
+        }
+        itemFlow[ c ] = q;
+    }
+    for( int r = 0; r < root.count(); r++ ) {
+        flow[ rootBranch[r] ] = itemFlow[ root[r] ];
+    }
+}
+
+
+/// distribute each composite flow held by its representative to all its branches
+void XMVentSolveHCReduction::expand( float* flow )
+{
+    QVector<double> itemFlow( kind.count(), 0. );
+    for( int r = 0; r < root.count(); r++ ) {
+        rootFlow[ r ] = flow[ rootBranch[r] ];
+        itemFlow[ root[r] ] = rootFlow[ r ];
+    }
+
+    // parents come after their children
+    for( int c = kind.count() - 1; c >= 0; c-- ) {
+        const double q = itemFlow[ c ];
+        bool shorted = false;
+        for( int k = childOffset[c]; k < childOffset[c+1]; k++ ) {
+            const int item = child[ k ];
+            double share = 1.;
+            if( kind[c] == Parallel ) {
+                // p = R_i Q_i^n across every member, the first short circuit takes it all
+                const float itemR = ( item < nBranches ? branchResistance[ item ] : resistance[ item - nBranches ] );
+                if( resistance[c] == 0.f ) {
+                    share = ( itemR == 0.f && !shorted ) ? 1. : 0.;
+                    shorted = shorted || itemR == 0.f;
+                } else {
+                    share = pow( double( resistance[c] ) / itemR, 1. / n[c] );
+                }
+            }
+            const double itemQ = childSign[ k ] * share * q;
+            if( item < nBranches ) {
+                flow[ item ] = itemQ;
+            } else {
+                itemFlow[ item - nBranches ] = itemQ;
+            }
+        }
+    }
+
+    expandedFlow.resize( nBranches );
+    for( int b = 0; b < nBranches; b++ ) {
+        expandedFlow[ b ] = flow[ b ];
+    }
+}
+
+
+/// branches making up an item
+void XMVentSolveHCReduction::leaves( int item, QVector<int>& branch ) const
+{
+    branch.clear();
+    QVector<int> stack;
+    stack.append( item );
+    while( !stack.isEmpty() ) {
+        const int i = stack.last();
+        stack.pop_back();
+        if( i < nBranches ) {
+            branch.append( i );
+        } else {
+            for( int k = childOffset[ i - nBranches ]; k < childOffset[ i - nBranches + 1 ]; k++ ) {
+                stack.append( child[k] );
+            }
+        }
+    }
+}
+
+
+/// number of branches left out of the reduced network
+int XMVentSolveHCReduction::hiddenCount() const
+{
+    int nHidden = -root.count();        // representatives stay
+    for( int k = 0; k < child.count(); k++ ) {
+        nHidden += ( child[k] < nBranches );
+    }
+    return nHidden;
+}
+
+
+void XMVentSolveHCReduction::clear()
+{
+    nBranches = 0;
+    nJunctions = 0;
+    kind.clear();
+    childOffset.fill( 0, 1 );
+    child.clear();
+    childSign.clear();
+    itemFrom.clear();
+    itemTo.clear();
+    branchRoot.clear();
+    root.clear();
+    rootBranch.clear();
+    resistance.clear();
+    n.clear();
+    branchResistance.clear();
+    expandedFlow.clear();
+    rootFlow.clear();
+}
+
+
+template<typename Real>
+struct MeshAdjust {
+    Real pressure;
+    Real slope;
+};
+
+
+/// sums of one law run; any precision other than float uses the scalar kernel
+template<int N, typename Flow, typename Real>
+inline void meshLawRun( XMVentMeshKernel::Function, int, const Flow* flow, const XMVentMeshSteps& steps,
+                        int begin, int end, Real& pressure, Real& slope )
+{
+    xmVentMeshKernelScalar<N>( flow, steps, begin, end, pressure, slope );
+}
+
+
+/// float runs at least a vector long go to the SIMD kernel
+template<int N>
+inline void meshLawRun( XMVentMeshKernel::Function vector, int width, const float* flow, const XMVentMeshSteps& steps,
+                        int begin, int end, float& pressure, float& slope )
+{
+    if( end - begin >= width ) {
+        vector( flow, steps, begin, end, pressure, slope );
+    } else {
+        xmVentMeshKernelScalar<N>( flow, steps, begin, end, pressure, slope );
+    }
+}
+
+
+/// calculate mesh pressure imbalance and slope (dP/dQ) for correction
+template<typename Flow, typename Real>
+inline MeshAdjust<Real> pressureAdjustMesh( const Flow* flow, const XMVentSolveHCProgram& program, int meshId )
+{
+    const XMVentMeshKernel& kernel = *program.kernel;
+    const XMVentMeshSteps steps = program.steps();
+    const int begin = program.meshOffset[ meshId ];
+    const int squareEnd = program.meshLawOffset[ 2*meshId ];
+    const int linearEnd = program.meshLawOffset[ 2*meshId + 1 ];
+    const int end = program.meshOffset[ meshId + 1 ];
+
+    // pressure += fsp + nvp - fan static pressure; slope += slope(fsp) + slope(nvp)
+    MeshAdjust<Real> adj;
+    adj.pressure = 0.;
+    adj.slope = 0.;
+    meshLawRun<2>( kernel.square, kernel.width, flow, steps, begin, squareEnd, adj.pressure, adj.slope );
+    if( linearEnd > squareEnd ) {
+        meshLawRun<1>( kernel.linear, kernel.width, flow, steps, squareEnd, linearEnd, adj.pressure, adj.slope );
+    }
+    if( end > linearEnd ) {
+        xmVentMeshKernelScalar<0>( flow, steps, linearEnd, end, adj.pressure, adj.slope );
+    }
+
+    // fan characteristics: pressure -= fan pressure; slope -= dP/dQ of the fan
+    if( !program.meshCurveOffset.isEmpty() ) {
+        for( int c = program.meshCurveOffset[ meshId ]; c < program.meshCurveOffset[ meshId + 1 ]; c++ ) {
+            const int k = program.curveStep[ c ];
+            Real fanSlope;
+            const Real fanPressure = program.fanCurve[ program.curveFan[c] ].pressure( Real( flow[ steps.branch[k] ] ), fanSlope );
+            adj.pressure -= steps.direction[ k ] * fanPressure;
+            adj.slope -= fanSlope;
+        }
+    }
+
+    return adj;
+}
+
+
+/// solve for next Hardy-Cross iteration step, the flow correction of each
+/// balanced mesh is returned in meshStep if given.  meshLambda optionally
+/// scales lambda per mesh.
+template<typename Flow, typename Real>
+Real ventSolveHCIterate( Flow* flow, const XMVentSolveHCProgram& program, float lambda, double* meshStep = 0,
+                         const float* meshLambda = 0 )
+{
+    const int* offset = program.meshOffset.constData();
+    const int* stepBranch = program.stepBranch.constData();
+    const qint8* stepDirection = program.stepDirection.constData();
+    Real meshCorrection = 0;
+
+    for( int i = 0; i < program.nMeshBalanced; i++ ) {  // for each mesh, but not fixed-flow meshes
+        // calculate correction
+        MeshAdjust<Real> adjust = pressureAdjustMesh<Flow,Real>( flow, program, i );
+
+        meshCorrection += fabs( adjust.pressure );
+
+        // apply correction
+        Real meshFlowCorrection = 0.;
+        if( adjust.slope != 0. ) { // TODO:AW: is this okay or should it be a fuzzy test for "too small"?
+            meshFlowCorrection = - adjust.pressure / adjust.slope * ( meshLambda ? lambda * meshLambda[i] : lambda );
+            for( int k = offset[i]; k < offset[i+1]; k++ ) {
+                // correction adjusted for branch direction
+                flow[ stepBranch[k] ] += stepDirection[ k ] * meshFlowCorrection;
+            }
+        }
+        if( meshStep ) {
+            meshStep[ i ] = meshFlowCorrection;
+        }
+    }
+
+    return meshCorrection;
+}
+
+
+/// correct the meshes listed in mesh[begin,end), or meshes [begin,end) if mesh
+/// is 0; used by the colored and block sweeps.  The absolute imbalance of each
+/// mesh is stored in meshPressure.
+template<typename Flow, typename Real>
+static void ventSolveHCCorrectMeshes( Flow* flow, const XMVentSolveHCProgram& program, const int* mesh,
+                                      int begin, int end, float lambda, const float* meshLambda,
+                                      double* meshPressure, double* meshStep )
+{
+    const int* offset = program.meshOffset.constData();
+    const int* stepBranch = program.stepBranch.constData();
+    const qint8* stepDirection = program.stepDirection.constData();
+
+    for( int m = begin; m < end; m++ ) {
+        const int i = ( mesh ? mesh[ m ] : m );
+        MeshAdjust<Real> adjust = pressureAdjustMesh<Flow,Real>( flow, program, i );
+        meshPressure[ i ] = fabs( adjust.pressure );
+
+        Real meshFlowCorrection = 0.;
+        if( adjust.slope != 0. ) {
+            meshFlowCorrection = - adjust.pressure / adjust.slope * ( meshLambda ? lambda * meshLambda[i] : lambda );
+            for( int k = offset[i]; k < offset[i+1]; k++ ) {
+                flow[ stepBranch[k] ] += stepDirection[ k ] * meshFlowCorrection;
+            }
+        }
+        if( meshStep ) {
+            meshStep[ i ] = meshFlowCorrection;
+        }
+    }
+}
+
+
+/// a slice of one color class, or a run of whole blocks, for the thread pool
+template<typename Flow, typename Real>
+class XMVentSolveHCColorTask : public QRunnable
+{
+protected:
+    Flow* m_flow;
+    const XMVentSolveHCProgram& m_program;
+    const int* m_mesh;
+    int m_begin, m_end;
+    float m_lambda;
+    const float* m_meshLambda;
+    double* m_meshPressure;
+    double* m_meshStep;
+
+public:
+    XMVentSolveHCColorTask( Flow* flow, const XMVentSolveHCProgram& program, const int* mesh, int begin, int end,
+                            float lambda, const float* meshLambda, double* meshPressure, double* meshStep ) :
+        m_flow( flow ), m_program( program ), m_mesh( mesh ), m_begin( begin ), m_end( end ), m_lambda( lambda ),
+        m_meshLambda( meshLambda ), m_meshPressure( meshPressure ), m_meshStep( meshStep ) {}
+
+    void run()
+    {
+        ventSolveHCCorrectMeshes<Flow,Real>( m_flow, m_program, m_mesh, m_begin, m_end,
+                                             m_lambda, m_meshLambda, m_meshPressure, m_meshStep );
+    }
+};
+
+
+/// Hardy-Cross step over the color classes of the program.  Meshes of one
+/// class share no branch so they are corrected concurrently; the classes are
+/// done one after another.  The result does not depend on the number of threads.
+template<typename Flow, typename Real>
+Real ventSolveHCIterateColored( Flow* flow, const XMVentSolveHCProgram& program, float lambda,
+                                QThreadPool* pool, double* meshPressure, double* meshStep = 0,
+                                const float* meshLambda = 0 )
+{
+    const int grain = 64;           // fewest meshes worth a task
+    const int nThreads = ( pool ? pool->maxThreadCount() : 1 );
+
+    for( int c = 0; c + 1 < program.colorOffset.count(); c++ ) {
+        const int begin = program.colorOffset[ c ];
+        const int end = program.colorOffset[ c + 1 ];
+        const int nTask = qMin( nThreads, ( end - begin ) / grain );
+        if( nTask <= 1 ) {
+            ventSolveHCCorrectMeshes<Flow,Real>( flow, program, program.colorMesh.constData(), begin, end,
+                                                 lambda, meshLambda, meshPressure, meshStep );
+            continue;
+        }
+        for( int t = 0; t < nTask; t++ ) {
+            pool->start( new XMVentSolveHCColorTask<Flow,Real>( flow, program, program.colorMesh.constData(),
+                                                                begin + ( end - begin ) * t / nTask,
+                                                                begin + ( end - begin ) * ( t + 1 ) / nTask,
+                                                                lambda, meshLambda, meshPressure, meshStep ) );
+        }
+        pool->waitForDone();
+    }
+
+    // summed in mesh order
+    Real meshCorrection = 0;
+    for( int i = 0; i < program.nMeshBalanced; i++ ) {
+        meshCorrection += Real( meshPressure[ i ] );
+    }
+
+    return meshCorrection;
+}
+
+
+/// Hardy-Cross step with the biconnected blocks shared out between threads.
+/// Blocks have no branch in common, so each thread sweeps its run of blocks in
+/// the plain mesh order and the result is that of ventSolveHCIterate().  Unless
+/// at least two runs are worth a task, that is what runs instead.
+template<typename Flow, typename Real>
+Real ventSolveHCIterateBlocks( Flow* flow, const XMVentSolveHCProgram& program, float lambda,
+                               QThreadPool* pool, double* meshPressure, double* meshStep = 0,
+                               const float* meshLambda = 0 )
+{
+    const int grain = 64;           // fewest meshes worth a task
+    const int nMesh = program.nMeshBalanced;
+    const int nTask = qMin( pool->maxThreadCount(), nMesh / grain );
+    const int nBlocks = program.blockOffset.count() - 1;
+
+    // cut the mesh range at block ends, about nMesh / nTask meshes per task
+    QVector<int> runEnd;
+    int nLarge = 0;
+    int begin = 0;
+    int b = 0;
+    for( int t = 1; t <= nTask && begin < nMesh; t++ ) {
+        const int target = ( t == nTask ? nMesh : qint64( nMesh ) * t / nTask );
+        while( b < nBlocks && program.blockOffset[ b + 1 ] < target ) {
+            b++;
+        }
+        const int end = ( b < nBlocks ? program.blockOffset[ b + 1 ] : nMesh );
+        if( end > begin ) {
+            runEnd.append( end );
+            nLarge += ( end - begin >= grain );
+        }
+        begin = end;
+    }
+    if( nLarge <= 1 ) {
+        return ventSolveHCIterate<Flow,Real>( flow, program, lambda, meshStep, meshLambda );
+    }
+
+    begin = 0;
+    for( int r = 0; r < runEnd.count(); r++ ) {
+        pool->start( new XMVentSolveHCColorTask<Flow,Real>( flow, program, 0, begin, runEnd[ r ],
+                                                            lambda, meshLambda, meshPressure, meshStep ) );
+        begin = runEnd[ r ];
+    }
+    pool->waitForDone();
+
+    // summed in mesh order
+    Real meshCorrection = 0;
+    for( int i = 0; i < nMesh; i++ ) {
+        meshCorrection += Real( meshPressure[ i ] );
+    }
+
+    return meshCorrection;
+}
+
+
+/// one Hardy-Cross step, colored and threaded if enabled
+template<typename Flow, typename Real>
+Real XMVentSolveHC::sweep( Flow* flow, float lambda, double* meshStep, const float* meshLambda )
+{
+    const int nThreads = ( m_threadCount > 0 ? m_threadCount : QThread::idealThreadCount() );
+    const bool blocks = ( nThreads > 1 && m_program.blockOffset.count() > 2 );
+    if( !m_meshColoring && !blocks ) {
+        return ventSolveHCIterate<Flow,Real>( flow, m_program, lambda, meshStep, meshLambda );
+    }
+    if( !m_meshColoring ) {
+        if( !m_threadPool ) {
+            m_threadPool = new QThreadPool( this );
+        }
+        m_threadPool->setMaxThreadCount( nThreads );
+        m_meshPressure.resize( m_program.nMeshBalanced );
+        return ventSolveHCIterateBlocks<Flow,Real>( flow, m_program, lambda, m_threadPool, m_meshPressure.data(),
+                                                    meshStep, meshLambda );
+    }
+
+    if( m_program.colorOffset.isEmpty() ) {
+        m_program.color();
+        qCDebug( xmVentLog ) << "Mesh colors:" << m_program.colorOffset.count() - 1;
+    }
+    if( !m_threadPool ) {
+        m_threadPool = new QThreadPool( this );
+    }
+    m_threadPool->setMaxThreadCount( nThreads );
+    m_meshPressure.resize( m_program.nMeshBalanced );
+
+    return ventSolveHCIterateColored<Flow,Real>( flow, m_program, lambda, m_threadPool, m_meshPressure.data(),
+                                                 meshStep, meshLambda );
+}
+
+
+/// move the balanced mesh flows by delta; branch flows stay balanced (Kirchhoff I)
+template<typename Flow>
+static void meshFlowShift( Flow* flow, const XMVentSolveHCProgram& program, const double* delta )
+{
+    const int* offset = program.meshOffset.constData();
+    const int* stepBranch = program.stepBranch.constData();
+    const qint8* stepDirection = program.stepDirection.constData();
+
+    for( int i = 0; i < program.nMeshBalanced; i++ ) {
+        if( delta[i] != 0. ) {
+            for( int k = offset[i]; k < offset[i+1]; k++ ) {
+                flow[ stepBranch[k] ] += stepDirection[ k ] * delta[ i ];
+            }
+        }
+    }
+}
+
+
+/// Convergence acceleration of the Hardy-Cross sweep x -> G(x) in mesh flow
+/// coordinates.  Extrapolating mesh flows rather than branch flows keeps every
+/// accelerated iterate balanced at the junctions.
+class XMVentSolveHCAccelerator
+{
+protected:
+    XMVentSolveHC::Acceleration m_type;
+    int m_depth;
+    int m_n;
+    QList<QVector<double> > m_x;        // Aitken: consecutive plain iterates
+    QList<QVector<double> > m_dG, m_dF; // Anderson: differences of G(x) and of G(x) - x
+    QVector<double> m_g, m_f;           // Anderson: last G(x) and G(x) - x
+
+public:
+    XMVentSolveHCAccelerator( XMVentSolveHC::Acceleration type, int depth, int n ) :
+        m_type( type ), m_depth( qMax( depth, 1 ) ), m_n( n ) {}
+
+    void reset()
+    {
+        m_x.clear();
+        m_dG.clear();
+        m_dF.clear();
+        m_g.clear();
+        m_f.clear();
+    }
+
+    /// record a sweep from x - step to x
+    void push( const QVector<double>& x, const QVector<double>& step )
+    {
+        if( m_type == XMVentSolveHC::Aitken ) {
+            if( m_x.isEmpty() ) {
+                QVector<double> base( x );
+                for( int i = 0; i < m_n; i++ ) {
+                    base[ i ] -= step[ i ];
+                }
+                m_x.append( base );
+            }
+            m_x.append( x );
+            return;
+        }
+
+        if( !m_g.isEmpty() ) {
+            QVector<double> dG( m_n ), dF( m_n );
+            for( int i = 0; i < m_n; i++ ) {
+                dG[ i ] = x[ i ] - m_g[ i ];
+                dF[ i ] = step[ i ] - m_f[ i ];
+            }
+            m_dG.append( dG );
+            m_dF.append( dF );
+            if( m_dF.count() > m_depth ) {
+                m_dG.removeFirst();
+                m_dF.removeFirst();
+            }
+        }
+        m_g = x;
+        m_f = step;
+    }
+
+    /// mesh flow change from x (the last G(x)) to the extrapolated iterate, false if none is due
+    bool extrapolate( const QVector<double>& x, QVector<double>& delta )
+    {
+        delta.fill( 0., m_n );
+
+        if( m_type == XMVentSolveHC::Aitken ) {
+            // Aitken's delta-squared process every third iterate, in the vector
+            // form of Irons and Tuck: one scale along the last step
+            if( m_x.count() < 3 ) {
+                return false;
+            }
+            const QVector<double>& x0 = m_x[ 0 ];
+            const QVector<double>& x1 = m_x[ 1 ];
+            double num = 0., denom = 0.;
+            for( int i = 0; i < m_n; i++ ) {
+                double d = x[i] - x1[i];
+                double d2 = x[i] - 2.*x1[i] + x0[i];
+                num += d * d2;
+                denom += d2 * d2;
+            }
+            if( denom > 0. ) {
+                for( int i = 0; i < m_n; i++ ) {
+                    delta[ i ] = - ( x[i] - x1[i] ) * num / denom;
+                }
+            }
+            m_x.clear();
+            return true;
+        }
+
+        // Anderson mixing: x' = G(x) - dG gamma with gamma = argmin | f - dF gamma |
+        const int m = m_dF.count();
+        if( m == 0 ) {
+            return false;
+        }
+        QVector<double> a( m * m ), gamma( m );
+        double trace = 0.;
+        for( int r = 0; r < m; r++ ) {
+            for( int c = 0; c <= r; c++ ) {
+                double sum = 0.;
+                for( int i = 0; i < m_n; i++ ) {
+                    sum += m_dF[r][i] * m_dF[c][i];
+                }
+                a[ r*m + c ] = a[ c*m + r ] = sum;
+            }
+            double sum = 0.;
+            for( int i = 0; i < m_n; i++ ) {
+                sum += m_dF[r][i] * m_f[i];
+            }
+            gamma[ r ] = sum;
+            trace += a[ r*m + r ];
+        }
+        if( trace <= 0. ) {
+            return false;
+        }
+
+        // regularized normal equations by Cholesky
+        for( int r = 0; r < m; r++ ) {
+            a[ r*m + r ] += 1e-10 * trace;
+        }
+        for( int c = 0; c < m; c++ ) {
+            double d = a[ c*m + c ];
+            for( int k = 0; k < c; k++ ) {
+                d -= a[ c*m + k ] * a[ c*m + k ];
+            }
+            if( d <= 0. ) {
+                return false;
+            }
+            a[ c*m + c ] = sqrt( d );
+            for( int r = c + 1; r < m; r++ ) {
+                double v = a[ r*m + c ];
+                for( int k = 0; k < c; k++ ) {
+                    v -= a[ r*m + k ] * a[ c*m + k ];
+                }
+                a[ r*m + c ] = v / a[ c*m + c ];
+            }
+        }
+        for( int r = 0; r < m; r++ ) {
+            for( int k = 0; k < r; k++ ) {
+                gamma[ r ] -= a[ r*m + k ] * gamma[ k ];
+            }
+            gamma[ r ] /= a[ r*m + r ];
+        }
+        for( int r = m - 1; r >= 0; r-- ) {
+            for( int k = r + 1; k < m; k++ ) {
+                gamma[ r ] -= a[ k*m + r ] * gamma[ k ];
+            }
+            gamma[ r ] /= a[ r*m + r ];
+        }
+
+        for( int c = 0; c < m; c++ ) {
+            for( int i = 0; i < m_n; i++ ) {
+                delta[ i ] -= m_dG[c][i] * gamma[ c ];
+            }
+        }
+        return true;
+    }
+};
+
+
+/// Adaptive over-relaxation.  The mean reduction ratio of the mesh imbalance is
+/// measured over a few sweeps and lambda is moved in whichever direction made
+/// it smaller, halving the move each time the direction reverses.  A growing
+/// imbalance cuts lambda back.  Meshes whose correction changes sign between
+/// sweeps are oscillating and get damped individually.
+class XMVentSolveHCRelaxation
+{
+protected:
+    float& m_lambda;
+    QVector<float>& m_meshLambda;       // per-mesh factor on top of lambda
+    QVector<double> m_lastStep;
+    float m_lastCorrection;
+    double m_logRatio;                  // summed over the current window
+    double m_lastRate;                  // mean log ratio of the previous window
+    float m_move;                       // signed lambda change per window
+    int m_nRatio;
+    int m_nSweep;
+    int m_nGrowth;                      // consecutive sweeps with a growing imbalance
+
+public:
+    XMVentSolveHCRelaxation( float& lambda, QVector<float>& meshLambda, int nMesh ) :
+        m_lambda( lambda ), m_meshLambda( meshLambda ), m_lastStep( nMesh, 0. ),
+        m_lastCorrection( +INFINITY ), m_logRatio( 0. ), m_lastRate( +INFINITY ),
+        m_move( 0.1f ), m_nRatio( 0 ), m_nSweep( 0 ), m_nGrowth( 0 )
+    {
+        m_meshLambda.fill( 1.f, nMesh );
+    }
+
+    void update( float meshCorrection, const QVector<double>& step )
+    {
+        const float lambdaMin = 0.5f;
+        const float lambdaMax = 1.9f;
+        const float meshLambdaMin = 0.25f;
+        const float moveMin = 0.02f;
+        const int window = 4;
+
+        for( int i = 0; i < m_meshLambda.count(); i++ ) {
+            if( step[i] * m_lastStep[i] < 0. ) {
+                m_meshLambda[ i ] = qMax( m_meshLambda[i] * 0.8f, meshLambdaMin );
+            } else {
+                m_meshLambda[ i ] = qMin( m_meshLambda[i] * 1.05f, 1.f );
+            }
+        }
+        m_lastStep = step;
+
+        const float lastCorrection = m_lastCorrection;
+        m_lastCorrection = meshCorrection;
+        if( !( lastCorrection < INFINITY ) || lastCorrection <= 0.f || meshCorrection <= 0.f ) {
+            return;
+        }
+        if( ++m_nSweep <= window ) {
+            return;     // start-up transient from the initial flows
+        }
+
+        const double ratio = meshCorrection / lastCorrection;
+        if( ratio >= 1. ) {
+            // not contracting: drop any over-relaxation first, under-relax only if it persists
+            if( m_lambda > 1.f ) {
+                m_lambda = 1.f + ( m_lambda - 1.f ) * 0.5f;
+            } else if( ++m_nGrowth > 1 ) {
+                m_lambda = qMax( m_lambda * 0.8f, lambdaMin );
+            }
+            m_move = -qMax( fabs( m_move ) * 0.5f, moveMin );
+            m_lastRate = +INFINITY;
+            m_logRatio = 0.;
+            m_nRatio = 0;
+            return;
+        }
+
+        m_nGrowth = 0;
+        m_logRatio += log( ratio );
+        if( ++m_nRatio < window ) {
+            return;
+        }
+
+        const double rate = m_logRatio / m_nRatio;
+        if( rate > m_lastRate ) {
+            // the last move made things worse, turn around
+            m_move = -m_move * 0.5f;
+            if( fabs( m_move ) < moveMin ) {
+                m_move = ( m_move < 0.f ? -moveMin : moveMin );
+            }
+        }
+        m_lastRate = rate;
+        m_lambda = qBound( lambdaMin, m_lambda + m_move, lambdaMax );
+        m_logRatio = 0.;
+        m_nRatio = 0;
+    }
+};
+
+
+/// Hardy-Cross iteration on flows stored as Flow with mesh sums accumulated as Real
+template<typename Flow, typename Real>
+int XMVentSolveHC::solveHardyCross( Flow* flow, float meshCorrectionTolerance, int iterationMax, float lambda,
+                                    const QVector<int>* seed )
+{
+    // Iterate to balance the network until tolerance achieved or maximum iterations
+    Real meshCorrection = +INFINITY;
+    int i;
+    int iterationStart = 0;
+    m_lambda = lambda;
+    m_meshLambda.clear();
+    if( seed ) {
+        iterationStart = solveIncremental<Flow,Real>( flow, *seed, meshCorrectionTolerance, iterationMax, lambda,
+                                                      meshCorrection );
+        m_statistics.residual = meshCorrection;
+        if( meshCorrection <= meshCorrectionTolerance ) {
+            return iterationStart;
+        }
+    }
+    if( m_acceleration == NoAcceleration && !m_adaptiveLambda ) {
+        for( i = iterationStart; (i < iterationMax) && (meshCorrection > meshCorrectionTolerance) ; i++ ) {
+            meshCorrection = sweep<Flow,Real>( flow, lambda );
+            m_statistics.record( i, meshCorrection );
+
+            //qDebug() << "Iteration" << i << "meshCorrection:" << meshCorrection;
+        }
+
+        return i;
+    }
+
+    const int nMesh = m_program.nMeshBalanced;
+    const int plainStepsAfterReject = 3;
+    XMVentSolveHCAccelerator accelerator( m_acceleration, m_accelerationDepth, nMesh );
+    XMVentSolveHCRelaxation relaxation( m_lambda, m_meshLambda, nMesh );
+    if( m_adaptiveLambda ) {
+        m_lambda = qMin( lambda, 1.f );     // raised from below by the estimate
+    }
+    QVector<double> x( nMesh, 0. ), step( nMesh ), delta( nMesh );
+    QVector<double> fallbackX;
+    QVector<Flow> fallbackFlow( m_flowList.count() );
+    Real fallbackCorrection = +INFINITY;
+    bool extrapolated = false;
+    int plainSteps = 0;
+
+    for( i = iterationStart; (i < iterationMax) && (meshCorrection > meshCorrectionTolerance) ; i++ ) {
+        meshCorrection = sweep<Flow,Real>( flow, m_lambda, step.data(), m_adaptiveLambda ? m_meshLambda.constData() : 0 );
+        m_statistics.record( i, meshCorrection );
+
+        if( extrapolated && meshCorrection > fallbackCorrection ) {
+            // safeguard: the extrapolated iterate increased the imbalance, resume from the plain step
+            std::copy( fallbackFlow.constBegin(), fallbackFlow.constEnd(), flow );
+            x = fallbackX;
+            meshCorrection = fallbackCorrection;
+            accelerator.reset();
+            plainSteps = plainStepsAfterReject;
+            extrapolated = false;
+            continue;
+        }
+        extrapolated = false;
+
+        for( int m = 0; m < nMesh; m++ ) {
+            x[ m ] += step[ m ];
+        }
+        if( meshCorrection <= meshCorrectionTolerance ) {
+            continue;
+        }
+
+        if( m_adaptiveLambda ) {
+            relaxation.update( meshCorrection, step );
+        }
+        if( m_acceleration == NoAcceleration ) {
+            continue;
+        }
+
+        accelerator.push( x, step );
+        if( plainSteps > 0 ) {
+            plainSteps--;
+            continue;
+        }
+        if( accelerator.extrapolate( x, delta ) ) {
+            std::copy( flow, flow + fallbackFlow.count(), fallbackFlow.begin() );
+            fallbackX = x;
+            fallbackCorrection = meshCorrection;
+            meshFlowShift( flow, m_program, delta.constData() );
+            for( int m = 0; m < nMesh; m++ ) {
+                x[ m ] += delta[ m ];
+            }
+            extrapolated = true;
+        }
+
+        //qDebug() << "Iteration" << i << "meshCorrection:" << meshCorrection;
+    }
+
+    return i;
+}
+
+
+/// Re-solve after a small change: only meshes holding a changed branch are
+/// corrected, and a correction queues the meshes sharing its branches.  Meshes
+/// are settled to the tolerance divided by the number of meshes, which may be
+/// out of reach in float, so the local pass stops after a few sweeps' worth of
+/// corrections and leaves the rest to full sweeps.  Returns the work done in
+/// whole sweeps; meshCorrection is the total imbalance afterwards.
+template<typename Flow, typename Real>
+int XMVentSolveHC::solveIncremental( Flow* flow, const QVector<int>& seed, float meshCorrectionTolerance,
+                                     int iterationMax, float lambda, Real& meshCorrection )
+{
+    const int nMesh = m_program.nMeshBalanced;
+    if( nMesh == 0 ) {
+        meshCorrection = 0.;
+        return 0;
+    }
+    if( m_program.branchMeshOffset.isEmpty() ) {
+        m_program.incidence();
+    }
+    const int* offset = m_program.meshOffset.constData();
+    const int* stepBranch = m_program.stepBranch.constData();
+    const qint8* stepDirection = m_program.stepDirection.constData();
+    const int* branchOffset = m_program.branchMeshOffset.constData();
+    const int* branchMesh = m_program.branchMesh.constData();
+    const Real meshTolerance = Real( meshCorrectionTolerance ) / nMesh;
+    const int sweepMax = 4;         // local work allowed before falling back to full sweeps
+    const qint64 visitMax = qint64( qMin( sweepMax, iterationMax - 1 ) ) * nMesh;
+
+    // ring buffer; a mesh is queued at most once, so nMesh entries are enough
+    QVector<int> queue( nMesh );
+    QVector<bool> queued( nMesh, false );
+    int head = 0;
+    int nQueued = 0;
+    QVector<int>::const_iterator itSeed;
+    for( itSeed = seed.begin(); itSeed != seed.end(); itSeed++ ) {
+        if( !queued[*itSeed] ) {
+            queued[ *itSeed ] = true;
+            queue[ ( head + nQueued++ ) % nMesh ] = *itSeed;
+        }
+    }
+
+    qint64 nVisit = 0;
+    while( nQueued > 0 && nVisit < visitMax ) {
+        const int i = queue[ head ];
+        head = ( head + 1 ) % nMesh;
+        nQueued--;
+        queued[ i ] = false;
+        nVisit++;
+
+        MeshAdjust<Real> adjust = pressureAdjustMesh<Flow,Real>( flow, m_program, i );
+        if( fabs( adjust.pressure ) <= meshTolerance || adjust.slope == 0. ) {
+            continue;
+        }
+
+        Real meshFlowCorrection = - adjust.pressure / adjust.slope * lambda;
+        for( int k = offset[i]; k < offset[i+1]; k++ ) {
+            const int b = stepBranch[ k ];
+            flow[ b ] += stepDirection[ k ] * meshFlowCorrection;
+
+            // meshes sharing the branch see the new flow (this one included)
+            for( int p = branchOffset[b]; p < branchOffset[b+1]; p++ ) {
+                if( !queued[ branchMesh[p] ] ) {
+                    queued[ branchMesh[p] ] = true;
+                    queue[ ( head + nQueued++ ) % nMesh ] = branchMesh[p];
+                }
+            }
+        }
+    }
+
+    meshCorrection = 0.;
+    for( int i = 0; i < nMesh; i++ ) {
+        meshCorrection += fabs( pressureAdjustMesh<Flow,Real>( flow, m_program, i ).pressure );
+    }
+
+    qCDebug( xmVentLog ) << "Incremental solve corrected" << nVisit << "meshes of" << nMesh << "imbalance:" << double( meshCorrection );
+    return int( ( nVisit + nMesh - 1 ) / nMesh );
+}
+
+
+/// Compare the gathered parameters with the last solution.  Fixed flow changes
+/// are applied to the flows here, so only incremental solves carry them over;
+/// otherwise they take a resetFlow().  Returns false if no incremental solve
+/// is possible, otherwise seed holds the balanced meshes to start from.
+bool XMVentSolveHC::changedMeshes( QVector<int>& seed )
+{
+    seed.clear();
+    const int nSteps = m_program.stepCount();
+    if( !m_solved.valid || m_solved.stepBranch.count() != nSteps
+        || m_solved.fixedFlow.count() != m_program.meshCount() - m_program.nMeshBalanced
+        || m_solved.flow != m_flowList ) {
+        return false;
+    }
+
+    QVector<int> changed;
+    for( int k = 0; k < nSteps; k++ ) {
+        if( m_solved.stepBranch[k] != m_program.stepBranch[k]
+            || m_solved.stepResistance[k] != m_program.stepResistance[k]
+            || m_solved.stepN[k] != m_program.stepN[k]
+            || m_solved.stepFanPressure[k] != m_program.stepFanPressure[k] ) {
+            changed.append( m_program.stepBranch[k] );
+            changed.append( m_solved.stepBranch[k] );
+        }
+    }
+
+    // branches of a fan whose characteristic changed
+    if( m_solved.fanCurve.count() != m_program.fanCurve.count() ) {
+        return false;
+    }
+    QMap<int,XMVentFan*>::const_iterator itFan;
+    for( itFan = m_ventNet->m_fanList.begin(); itFan != m_ventNet->m_fanList.end(); itFan++ ) {
+        const int f = m_ventNet->m_fanDefinition.indexOf( itFan.value() );
+        if( !( m_solved.fanCurve[f] == m_program.fanCurve[f] ) ) {
+            changed.append( itFan.key() );
+        }
+    }
+
+    // a new fixed flow moves the flow of its whole mesh
+    QMap<int, float>::const_iterator itFixedFlow = m_ventNet->m_fixedFlow.begin();
+    for( int i = m_program.nMeshBalanced; i < m_program.meshCount(); i++, itFixedFlow++ ) {
+        const float delta = itFixedFlow.value() - m_solved.fixedFlow[ i - m_program.nMeshBalanced ];
+        if( delta == 0.f ) {
+            continue;
+        }
+        for( int k = m_program.meshOffset[i]; k < m_program.meshOffset[i+1]; k++ ) {
+            const int b = m_program.stepBranch[ k ];
+            m_flowList[ b ] += m_program.stepDirection[ k ] * delta;
+            if( b < m_flowDouble.count() ) {
+                m_flowDouble[ b ] += m_program.stepDirection[ k ] * double( delta );
+            }
+            changed.append( b );
+        }
+    }
+
+    if( m_program.branchMeshOffset.isEmpty() ) {
+        m_program.incidence();
+    }
+    const int nIncident = m_program.branchMeshOffset.count() - 1;
+    QVector<int>::const_iterator itBranch;
+    for( itBranch = changed.begin(); itBranch != changed.end(); itBranch++ ) {
+        if( *itBranch < nIncident ) {
+            for( int p = m_program.branchMeshOffset[*itBranch]; p < m_program.branchMeshOffset[*itBranch + 1]; p++ ) {
+                seed.append( m_program.branchMesh[p] );
+            }
+        }
+    }
+
+    return true;
+}
+
+
+/// remember the converged state for the next incremental solve
+void XMVentSolveHC::saveSolved()
+{
+    m_solved.valid = true;
+    m_solved.stepBranch = m_program.stepBranch;
+    m_solved.stepResistance = m_program.stepResistance;
+    m_solved.stepN = m_program.stepN;
+    m_solved.stepFanPressure = m_program.stepFanPressure;
+    m_solved.fanCurve = m_program.fanCurve;
+    m_solved.fixedFlow.clear();
+    QMap<int, float>::const_iterator itFixedFlow;
+    for( itFixedFlow = m_ventNet->m_fixedFlow.begin(); itFixedFlow != m_ventNet->m_fixedFlow.end(); itFixedFlow++ ) {
+        m_solved.fixedFlow.append( itFixedFlow.value() );
+    }
+    m_solved.flow = m_flowList;
+}
+
+
+void XMVentSolveHCSnapshot::clear()
+{
+    valid = false;
+    stepBranch.clear();
+    stepResistance.clear();
+    stepN.clear();
+    stepFanPressure.clear();
+    fanCurve.clear();
+    fixedFlow.clear();
+    flow.clear();
+}
+
+
+/// Hardy-Cross iteration in the selected precision, returns the number of iterations used
+int XMVentSolveHC::solveHardyCross( float meshCorrectionTolerance, int iterationMax, float lambda )
+{
+    QVector<int> seed;
+    const bool incremental = m_incremental && changedMeshes( seed );
+    const QVector<int>* seedList = ( incremental ? &seed : 0 );
+    m_solved.valid = false;
+
+    int i = solveHardyCrossPrecision( meshCorrectionTolerance, iterationMax, lambda, seedList );
+    if( m_incremental && i < iterationMax ) {
+        saveSolved();
+    }
+
+    return i;
+}
+
+
+/// dispatch on the precision
+int XMVentSolveHC::solveHardyCrossPrecision( float meshCorrectionTolerance, int iterationMax, float lambda,
+                                             const QVector<int>* seed )
+{
+    if( m_precision == Single ) {
+        return solveHardyCross<float,float>( m_flowList.data(), meshCorrectionTolerance, iterationMax, lambda, seed );
+    }
+    if( m_precision == Mixed ) {
+        return solveHardyCross<float,double>( m_flowList.data(), meshCorrectionTolerance, iterationMax, lambda, seed );
+    }
+
+    // keep the double flows between solves unless the float flows were changed meanwhile
+    const int nBranches = m_flowList.count();
+    if( m_flowDouble.count() != nBranches ) {
+        m_flowDouble.resize( nBranches );
+        for( int b = 0; b < nBranches; b++ ) {
+            m_flowDouble[ b ] = m_flowList[ b ];
+        }
+    }
+    for( int b = 0; b < nBranches; b++ ) {
+        if( float( m_flowDouble[b] ) != m_flowList[b] ) {
+            m_flowDouble[ b ] = m_flowList[ b ];
+        }
+    }
+
+    int i = solveHardyCross<double,double>( m_flowDouble.data(), meshCorrectionTolerance, iterationMax, lambda, seed );
+
+    for( int b = 0; b < nBranches; b++ ) {
+        m_flowList[ b ] = m_flowDouble[ b ];
+    }
+
+    return i;
+}
+
+
+/// transpose the balanced meshes to branch -> mesh incidence and build the
+/// Jacobian pattern.  Two meshes couple wherever they share a branch.
+void XMVentSolveHCJacobian::build( const XMVentSolveHCProgram& program, int nBranches )
+{
+    const int nMesh = program.nMeshBalanced;
+    const int nSteps = program.meshOffset[ nMesh ];
+    const int* stepBranch = program.stepBranch.constData();
+
+    branchOffset.fill( 0, nBranches + 1 );
+    for( int k = 0; k < nSteps; k++ ) {
+        branchOffset[ stepBranch[k] + 1 ]++;
+    }
+    for( int b = 0; b < nBranches; b++ ) {
+        branchOffset[ b + 1 ] += branchOffset[ b ];
+    }
+
+    branchMesh.resize( nSteps );
+    branchDirection.resize( nSteps );
+    QVector<int> next( branchOffset );
+    for( int i = 0; i < nMesh; i++ ) {
+        for( int k = program.meshOffset[i]; k < program.meshOffset[i+1]; k++ ) {
+            int p = next[ stepBranch[k] ]++;
+            branchMesh[ p ] = i;
+            branchDirection[ p ] = program.stepDirection[ k ];
+        }
+    }
+
+    QVector<QVector<int> > rowColumns( nMesh );
+    for( int b = 0; b < nBranches; b++ ) {
+        for( int p = branchOffset[b]; p < branchOffset[b+1]; p++ ) {
+            for( int q = branchOffset[b]; q < branchOffset[b+1]; q++ ) {
+                rowColumns[ branchMesh[p] ].append( branchMesh[q] );
+            }
+        }
+    }
+    matrix.setPattern( nMesh, rowColumns );
+
+    branchScatter.clear();
+    for( int b = 0; b < nBranches; b++ ) {
+        for( int p = branchOffset[b]; p < branchOffset[b+1]; p++ ) {
+            for( int q = branchOffset[b]; q < branchOffset[b+1]; q++ ) {
+                branchScatter.append( matrix.find( branchMesh[p], branchMesh[q] ) );
+            }
+        }
+    }
+
+    factor.analyze( matrix );
+}
+
+
+/// J[m][l] = sum over shared branches of direction(m) * direction(l) * dP/dQ
+void XMVentSolveHCJacobian::assemble( const double* branchSlope )
+{
+    double* value = matrix.value.data();
+    const int* scatter = branchScatter.constData();
+    const int nBranches = branchOffset.count() - 1;
+
+    matrix.value.fill( 0. );
+    int s = 0;
+    for( int b = 0; b < nBranches; b++ ) {
+        const double slope = branchSlope[ b ];
+        for( int p = branchOffset[b]; p < branchOffset[b+1]; p++ ) {
+            for( int q = branchOffset[b]; q < branchOffset[b+1]; q++ ) {
+                value[ scatter[s++] ] += branchDirection[ p ] * branchDirection[ q ] * slope;
+            }
+        }
+    }
+}
+
+
+void XMVentSolveHCJacobian::clear()
+{
+    branchOffset.clear();
+    branchMesh.clear();
+    branchDirection.clear();
+    branchScatter.clear();
+    matrix.clear();
+    factor.clear();
+}
+
+
+/// mesh pressure imbalance of all balanced meshes in double precision; also
+/// records dP/dQ of every branch visited.  Returns the summed absolute imbalance.
+static double newtonResidual( const double* flow, const XMVentSolveHCProgram& program,
+                              double* residual, double* branchSlope )
+{
+    const int* stepBranch = program.stepBranch.constData();
+    const qint8* stepDirection = program.stepDirection.constData();
+    const float* resistance = program.stepResistance.constData();
+    const float* stepN = program.stepN.constData();
+    const float* fanPressure = program.stepFanPressure.constData();
+
+    double meshCorrection = 0.;
+    for( int i = 0; i < program.nMeshBalanced; i++ ) {
+        double pressure = 0.;
+        for( int k = program.meshOffset[i]; k < program.meshOffset[i+1]; k++ ) {
+            const int branchId = stepBranch[ k ];
+            const double n = stepN[ k ];
+            const double q = stepDirection[ k ] * flow[ branchId ];
+            const double rq = pow( fabs(q), n - 1. ) * resistance[ k ];
+            pressure += rq * q - fanPressure[ k ];
+            branchSlope[ branchId ] = n * rq;
+        }
+        if( !program.meshCurveOffset.isEmpty() ) {
+            for( int c = program.meshCurveOffset[i]; c < program.meshCurveOffset[i+1]; c++ ) {
+                const int k = program.curveStep[ c ];
+                double fanSlope;
+                pressure -= stepDirection[ k ] * program.fanCurve[ program.curveFan[c] ].pressure( flow[ stepBranch[k] ], fanSlope );
+            }
+        }
+        residual[ i ] = pressure;
+        meshCorrection += fabs( pressure );
+    }
+
+    // a fan characteristic adds to the branch slope once, however many meshes share the branch
+    if( !program.meshCurveOffset.isEmpty() ) {
+        for( int c = 0; c < program.meshCurveOffset[ program.nMeshBalanced ]; c++ ) {
+            const int k = program.curveStep[ c ];
+            const int branchId = stepBranch[ k ];
+            const double n = stepN[ k ];
+            double fanSlope;
+            program.fanCurve[ program.curveFan[c] ].pressure( flow[ branchId ], fanSlope );
+            branchSlope[ branchId ] = n * pow( fabs( flow[ branchId ] ), n - 1. ) * resistance[ k ] - fanSlope;
+        }
+    }
+
+    return meshCorrection;
+}
+
+
+/// Newton-Raphson on the mesh flows: solve J dQ = -F for all mesh corrections
+/// at once.  The step is halved while it does not reduce the summed mesh
+/// imbalance, which keeps the first iterations from far-off initial flows stable.
+int XMVentSolveHC::solveNewtonRaphson( float meshCorrectionTolerance, int iterationMax )
+{
+    const int nMesh = m_program.nMeshBalanced;
+    const int nBranches = m_flowList.count();
+    if( m_jacobian.matrix.n != nMesh || !m_jacobian.factor.isAnalyzed() ) {
+        m_jacobian.build( m_program, nBranches );
+    }
+
+    const int* offset = m_program.meshOffset.constData();
+    const int* stepBranch = m_program.stepBranch.constData();
+    const qint8* stepDirection = m_program.stepDirection.constData();
+
+    QVector<double> flow( nBranches ), trial( nBranches ), slope( nBranches, 0. );
+    QVector<double> residual( nMesh ), delta( nMesh );
+    for( int b = 0; b < nBranches; b++ ) {
+        flow[ b ] = m_flowList[ b ];
+    }
+
+    double meshCorrection = newtonResidual( flow.constData(), m_program, residual.data(), slope.data() );
+    m_statistics.residual = meshCorrection;
+    int i;
+    for( i = 0; (i < iterationMax) && (meshCorrection > meshCorrectionTolerance); i++ ) {
+        m_jacobian.assemble( slope.constData() );
+        m_jacobian.factor.factorize( m_jacobian.matrix );
+        for( int m = 0; m < nMesh; m++ ) {
+            delta[ m ] = -residual[ m ];
+        }
+        m_jacobian.factor.solve( delta.data() );
+
+        double lambda = 1.;
+        for( int halving = 0; ; halving++ ) {
+            trial = flow;
+            for( int m = 0; m < nMesh; m++ ) {
+                const double correction = lambda * delta[ m ];
+                for( int k = offset[m]; k < offset[m+1]; k++ ) {
+                    trial[ stepBranch[k] ] += stepDirection[ k ] * correction;
+                }
+            }
+
+            double trialCorrection = newtonResidual( trial.constData(), m_program, residual.data(), slope.data() );
+            if( trialCorrection < meshCorrection || halving == 10 ) {
+                flow.swap( trial );
+                meshCorrection = trialCorrection;
+                break;
+            }
+            lambda *= 0.5;
+        }
+        m_statistics.record( i, meshCorrection );
+
+        //qDebug() << "Newton iteration" << i << "meshCorrection:" << meshCorrection;
+    }
+
+    for( int b = 0; b < nBranches; b++ ) {
+        m_flowList[ b ] = flow[ b ];
+    }
+
+    return i;
+}
+
+
+/// find the representative of a union-find set, halving the path on the way
+static int unionFind( QVector<int>& parent, int i )
+{
+    while( parent[i] != i ) {
+        parent[ i ] = parent[ parent[i] ];
+        i = parent[ i ];
+    }
+    return i;
+}
+
+
+/// contract the network into pressure nodes and build the conductance matrix pattern
+void XMVentSolveHCNodal::build( const XMVentNetwork* net )
+{
+    const int nJunctions = net->m_junction.count();
+    const int nBranches = net->m_branch.count();
+
+    // all surface junctions share the atmosphere pressure
+    QVector<int> group( nJunctions );
+    for( int j = 0; j < nJunctions; j++ ) {
+        group[ j ] = j;
+    }
+    int firstSurface = -1;
+    for( int j = 0; j < nJunctions; j++ ) {
+        if( net->m_junction.isSurface( j ) ) {
+            if( firstSurface < 0 ) {
+                firstSurface = j;
+            } else {
+                group[ unionFind( group, j ) ] = unionFind( group, firstSurface );
+            }
+        }
+    }
+
+    // zero resistance branches join their end junctions
+    branchKind.resize( nBranches );
+    const XMVentBranchTable& branch = net->m_branch;
+    for( int b = 0; b < nBranches; b++ ) {
+        if( net->m_fixedFlow.contains( b ) ) {
+            branchKind[ b ] = Fixed;
+        } else if( branch.resistance[b] == 0.f && !net->m_fanList.contains( b ) ) {
+            branchKind[ b ] = Contracted;
+            group[ unionFind( group, branch.from[b] ) ] = unionFind( group, branch.to[b] );
+        } else {
+            branchKind[ b ] = Free;
+        }
+    }
+
+    // number the nodes and collect reference pressures
+    int nNodes = 0;
+    QVector<int> rootNode( nJunctions, -1 );
+    junctionNode.resize( nJunctions );
+    for( int j = 0; j < nJunctions; j++ ) {
+        int root = unionFind( group, j );
+        if( rootNode[root] < 0 ) {
+            rootNode[ root ] = nNodes++;
+        }
+        junctionNode[ j ] = rootNode[ root ];
+    }
+
+    QVector<bool> nodeReference( nNodes, false );
+    nodePressure.fill( 0., nNodes );
+    for( int j = 0; j < nJunctions; j++ ) {
+        if( net->m_junction.hasReferencePressure( j ) && !nodeReference[ junctionNode[j] ] ) {
+            nodeReference[ junctionNode[j] ] = true;
+            nodePressure[ junctionNode[j] ] = net->m_junction.pressure[ j ];
+        }
+    }
+    if( firstSurface >= 0 ) {
+        nodeReference[ junctionNode[firstSurface] ] = true;   // atmosphere defaults to 0 Pa
+    }
+
+    branchFrom.resize( nBranches );
+    branchTo.resize( nBranches );
+    for( int b = 0; b < nBranches; b++ ) {
+        branchFrom[ b ] = junctionNode[ branch.from[b] ];
+        branchTo[ b ] = junctionNode[ branch.to[b] ];
+    }
+
+    // every part of the network coupled through free branches needs a reference
+    QVector<int> component( nNodes );
+    for( int i = 0; i < nNodes; i++ ) {
+        component[ i ] = i;
+    }
+    for( int b = 0; b < nBranches; b++ ) {
+        if( branchKind[b] == Free ) {
+            component[ unionFind( component, branchFrom[b] ) ] = unionFind( component, branchTo[b] );
+        }
+    }
+    QVector<bool> componentReference( nNodes, false );
+    for( int i = 0; i < nNodes; i++ ) {
+        if( nodeReference[i] ) {
+            componentReference[ unionFind( component, i ) ] = true;
+        }
+    }
+    for( int i = 0; i < nNodes; i++ ) {
+        int root = unionFind( component, i );
+        if( !componentReference[root] ) {
+            componentReference[ root ] = true;
+            nodeReference[ i ] = true;
+        }
+    }
+
+    int nUnknown = 0;
+    nodeUnknown.resize( nNodes );
+    for( int i = 0; i < nNodes; i++ ) {
+        nodeUnknown[ i ] = ( nodeReference[i] ? -1 : nUnknown++ );
+    }
+
+    // conductance matrix pattern and the branch scatter map
+    QVector<QVector<int> > rowColumns( nUnknown );
+    for( int i = 0; i < nUnknown; i++ ) {
+        rowColumns[ i ].append( i );
+    }
+    for( int b = 0; b < nBranches; b++ ) {
+        int u = nodeUnknown[ branchFrom[b] ];
+        int v = nodeUnknown[ branchTo[b] ];
+        if( branchKind[b] == Free && u >= 0 && v >= 0 && u != v ) {
+            rowColumns[ u ].append( v );
+            rowColumns[ v ].append( u );
+        }
+    }
+    matrix.setPattern( nUnknown, rowColumns );
+
+    branchScatter.fill( -1, 4 * nBranches );
+    for( int b = 0; b < nBranches; b++ ) {
+        int u = nodeUnknown[ branchFrom[b] ];
+        int v = nodeUnknown[ branchTo[b] ];
+        if( branchKind[b] != Free || branchFrom[b] == branchTo[b] ) {
+            continue;
+        }
+        if( u >= 0 ) {
+            branchScatter[ 4*b ] = matrix.find( u, u );
+        }
+        if( v >= 0 ) {
+            branchScatter[ 4*b + 1 ] = matrix.find( v, v );
+        }
+        if( u >= 0 && v >= 0 ) {
+            branchScatter[ 4*b + 2 ] = matrix.find( u, v );
+            branchScatter[ 4*b + 3 ] = matrix.find( v, u );
+        }
+    }
+    pcg.clear();
+
+    // spanning forest of the contracted branches, stored leaves first
+    XMVentSolveHCGraph contracted;
+    contracted.nJunctions = nJunctions;
+    contracted.branchFrom.fill( -1, nBranches );
+    contracted.branchTo.fill( -1, nBranches );
+    for( int b = 0; b < nBranches; b++ ) {
+        if( branchKind[b] == Contracted ) {
+            contracted.branchFrom[ b ] = branch.from[ b ];
+            contracted.branchTo[ b ] = branch.to[ b ];
+        }
+    }
+    XMVentSolveHCAdjacency treeAdj;
+    treeAdj.build( contracted );
+    treeBranch.clear();
+    treeChild.clear();
+    QVector<bool> visited( nJunctions, false );
+    for( int j = 0; j < nJunctions; j++ ) {
+        if( visited[j] || 0 == treeAdj.degree( j ) ) {
+            continue;
+        }
+        visited[ j ] = true;
+        int head = treeChild.count();
+        int root = j;
+        for( ;; ) {
+            for( const XMVentSolveHCStep* step = treeAdj.begin( root ); step != treeAdj.end( root ); step++ ) {
+                const int other = step->toNodeId;
+                if( !visited[other] ) {
+                    visited[ other ] = true;
+                    treeBranch.append( step->branchId );
+                    treeChild.append( other );
+                }
+            }
+            if( head >= treeChild.count() ) {
+                break;
+            }
+            root = treeChild[ head++ ];
+        }
+    }
+    std::reverse( treeBranch.begin(), treeBranch.end() );
+    std::reverse( treeChild.begin(), treeChild.end() );
+
+    branchResistance.resize( nBranches );
+    branchN.resize( nBranches );
+    branchFanPressure.resize( nBranches );
+    branchCurve.resize( nBranches );
+    gather( net );
+}
+
+
+/// refresh branch parameters; returns false if the contraction no longer matches the network
+bool XMVentSolveHCNodal::gather( const XMVentNetwork* net )
+{
+    const int nBranches = net->m_branch.count();
+    if( branchKind.count() != nBranches || junctionNode.count() != net->m_junction.count() ) {
+        return false;
+    }
+
+    const XMVentBranchTable& branch = net->m_branch;
+    for( int b = 0; b < nBranches; b++ ) {
+        bool contracted = ( branch.resistance[b] == 0.f && !net->m_fanList.contains( b )
+                            && branchKind[b] != Fixed );
+        if( contracted != ( branchKind[b] == Contracted ) ) {
+            return false;
+        }
+        branchResistance[ b ] = branch.resistance[ b ];
+        branchN[ b ] = branch.n[ b ];
+        branchFanPressure[ b ] = 0.f;
+        branchCurve[ b ] = -1;
+    }
+
+    xmVentFanCurves( net, fanCurve );
+    QMap<int,XMVentFan*>::const_iterator itFan;
+    for( itFan = net->m_fanList.begin(); itFan != net->m_fanList.end(); itFan++ ) {
+        if( itFan.value()->hasCurve() ) {
+            branchCurve[ itFan.key() ] = net->m_fanDefinition.indexOf( itFan.value() );
+        } else {
+            branchFanPressure[ itFan.key() ] = itFan.value()->fixedPressure();
+        }
+    }
+
+    return true;
+}
+
+
+/// contracted branches carry whatever flow balances their junctions (Kirchhoff I)
+void XMVentSolveHCNodal::recoverContractedFlow( const XMVentNetwork* net, float* flow ) const
+{
+    const int nBranches = net->m_branch.count();
+    QVector<double> excess( net->m_junction.count(), 0. );     // inflow - outflow
+    const XMVentBranchTable& branch = net->m_branch;
+    for( int b = 0; b < nBranches; b++ ) {
+        if( branchKind[b] == Contracted ) {
+            flow[ b ] = 0.f;
+        } else {
+            excess[ branch.from[b] ] -= flow[ b ];
+            excess[ branch.to[b] ] += flow[ b ];
+        }
+    }
+
+    for( int t = 0; t < treeBranch.count(); t++ ) {
+        const int b = treeBranch[ t ];
+        const int child = treeChild[ t ];
+        double q;
+        if( branch.to[b] == child ) {
+            q = -excess[ child ];
+            excess[ branch.from[b] ] -= q;
+        } else {
+            q = excess[ child ];
+            excess[ branch.to[b] ] += q;
+        }
+        flow[ treeBranch[t] ] = q;
+    }
+}
+
+
+void XMVentSolveHCNodal::clear()
+{
+    junctionNode.clear();
+    nodeUnknown.clear();
+    nodePressure.clear();
+    branchFrom.clear();
+    branchTo.clear();
+    branchKind.clear();
+    branchScatter.clear();
+    treeBranch.clear();
+    treeChild.clear();
+    branchResistance.clear();
+    branchN.clear();
+    branchFanPressure.clear();
+    branchCurve.clear();
+    fanCurve.clear();
+    matrix.clear();
+    pcg.clear();
+}
+
+
+/// Junction pressure formulation (global gradient method).  Each free branch is
+/// linearized about its current flow as a conductance g = 1 / (dP/dQ), the
+/// junction pressures follow from Kirchhoff I by preconditioned CG and the branch
+/// flows are updated from the new pressures.  The tolerance is the summed
+/// absolute branch pressure imbalance |R|Q|^(n-1)Q - dp - fan| in Pa.
+int XMVentSolveHC::solveJunctionPressure( float branchPressureTolerance, int iterationMax )
+{
+    const double flowMin = 1e-3;        // keeps dP/dQ of square law branches away from 0
+    const double slopeMin = 1e-6;
+
+    // building the node system counts as the graph time, the rest as iteration
+    QElapsedTimer timer;
+    timer.start();
+    XMVentSolveHCNodal& nodal = m_nodal;
+    if( !nodal.gather( m_ventNet ) ) {
+        nodal.build( m_ventNet );
+        m_statistics.graphTime = timer.nsecsElapsed() * 1e-6;
+        m_statistics.meshTime = 0.;
+        timer.start();
+    }
+
+    const int nBranches = m_ventNet->m_branch.count();
+    if( m_flowList.count() != nBranches ) {
+        m_flowList.fill( 1.f, nBranches );
+    }
+    QMap<int,float>::const_iterator itFixedFlow;
+    for( itFixedFlow = m_ventNet->m_fixedFlow.begin(); itFixedFlow != m_ventNet->m_fixedFlow.end(); itFixedFlow++ ) {
+        m_flowList[ itFixedFlow.key() ] = itFixedFlow.value();
+    }
+
+    const int nUnknown = nodal.matrix.n;
+    const int nNodes = nodal.nodeUnknown.count();
+    const int* unknown = nodal.nodeUnknown.constData();
+    double* pressure = nodal.nodePressure.data();
+    QVector<double> flow( nBranches ), slopeInv( nBranches, 0. ), flowOffset( nBranches, 0. );
+    QVector<double> rhs( nUnknown ), x( nUnknown );
+    for( int b = 0; b < nBranches; b++ ) {
+        flow[ b ] = m_flowList[ b ];
+    }
+    for( int k = 0; k < nNodes; k++ ) {
+        if( unknown[k] >= 0 ) {
+            x[ unknown[k] ] = pressure[ k ];    // warm start from the last solution
+        }
+    }
+
+    double residual = +INFINITY;
+    int i;
+    for( i = 0; (i < iterationMax) && (residual > branchPressureTolerance); i++ ) {
+        double* value = nodal.matrix.value.data();
+        nodal.matrix.value.fill( 0. );
+        rhs.fill( 0. );
+
+        for( int b = 0; b < nBranches; b++ ) {
+            const int from = nodal.branchFrom[ b ];
+            const int to = nodal.branchTo[ b ];
+            const int u = unknown[ from ];
+            const int v = unknown[ to ];
+
+            if( nodal.branchKind[b] == XMVentSolveHCNodal::Fixed ) {
+                // fixed flows are known injections
+                if( u >= 0 ) rhs[ u ] -= flow[ b ];
+                if( v >= 0 ) rhs[ v ] += flow[ b ];
+                continue;
+            }
+            if( nodal.branchKind[b] != XMVentSolveHCNodal::Free ) {
+                continue;
+            }
+
+            // Q' = g (p_from - p_to) + y
+            const double r = nodal.branchResistance[ b ];
+            const double n = nodal.branchN[ b ];
+            const double q = flow[ b ];
+            double fanSlope;
+            const double fanPressure = nodal.fanPressure( b, q, fanSlope );
+            const double slope = qMax( n * r * pow( qMax( fabs(q), flowMin ), n - 1. ) - fanSlope, slopeMin );
+            const double g = 1. / slope;
+            const double y = q + g * ( fanPressure - r * pow( fabs(q), n - 1. ) * q );
+            slopeInv[ b ] = g;
+            flowOffset[ b ] = y;
+
+            if( from == to ) {
+                continue;
+            }
+            const int* scatter = nodal.branchScatter.constData() + 4 * b;
+            if( u >= 0 ) {
+                value[ scatter[0] ] += g;
+                rhs[ u ] -= y;
+                if( v < 0 ) rhs[ u ] += g * pressure[ to ];
+            }
+            if( v >= 0 ) {
+                value[ scatter[1] ] += g;
+                rhs[ v ] += y;
+                if( u < 0 ) rhs[ v ] += g * pressure[ from ];
+            }
+            if( u >= 0 && v >= 0 ) {
+                value[ scatter[2] ] -= g;
+                value[ scatter[3] ] -= g;
+            }
+        }
+
+        nodal.pcg.setup( nodal.matrix );
+        nodal.pcg.solve( nodal.matrix, rhs.constData(), x.data(), 1e-10, 10 * nUnknown + 100 );
+        for( int k = 0; k < nNodes; k++ ) {
+            if( unknown[k] >= 0 ) {
+                pressure[ k ] = x[ unknown[k] ];
+            }
+        }
+
+        // new branch flows and the remaining branch pressure imbalance
+        residual = 0.;
+        for( int b = 0; b < nBranches; b++ ) {
+            if( nodal.branchKind[b] != XMVentSolveHCNodal::Free ) {
+                continue;
+            }
+            const double dp = pressure[ nodal.branchFrom[b] ] - pressure[ nodal.branchTo[b] ];
+            const double q = slopeInv[ b ] * dp + flowOffset[ b ];
+            const double r = nodal.branchResistance[ b ];
+            double fanSlope;
+            flow[ b ] = q;
+            residual += fabs( r * pow( fabs(q), nodal.branchN[b] - 1. ) * q - dp - nodal.fanPressure( b, q, fanSlope ) );
+        }
+
+        m_statistics.record( i, residual );
+
+        //qDebug() << "Junction pressure iteration" << i << "residual:" << residual;
+    }
+    m_statistics.imbalance = residual;
+
+    for( int b = 0; b < nBranches; b++ ) {
+        m_flowList[ b ] = flow[ b ];
+    }
+    nodal.recoverContractedFlow( m_ventNet, m_flowList.data() );
+
+    m_pressureList.resize( nodal.junctionNode.count() );
+    for( int j = 0; j < nodal.junctionNode.count(); j++ ) {
+        m_pressureList[ j ] = pressure[ nodal.junctionNode[j] ];
+    }
+    m_statistics.iterationTime = timer.nsecsElapsed() * 1e-6;
+
+    return i;
+}
+
+
+/// Ventilation network solution using the selected method
+/// tolerance - sum of absolute mesh pressure error in pascals?
+bool XMVentSolveHC::solve( float meshCorrectionTolerance, int iterationMax, float lambda )
+{
+    static const char* const methodName[] = { "HardyCross", "NewtonRaphson", "JunctionPressure" };
+    m_statistics.clearSolve();
+    m_statistics.method = methodName[ m_method ];
+    m_statistics.tolerance = meshCorrectionTolerance;
+    QElapsedTimer timer;
+
+    if( m_method == JunctionPressure ) {
+        // no meshes required
+        m_iterations = solveJunctionPressure( meshCorrectionTolerance, iterationMax );
+    } else {
+        // initialize if it has not already been done
+        if( m_meshList.count() == 0 ) {
+            initialize();
+        }
+
+        // a reduced branch may have gained a fan, fixed flow or different n
+        if( m_reduction.isReduced() && !m_reduction.evaluate( m_ventNet ) ) {
+            qCDebug( xmVentLog ) << "Reduced branches changed, reinitializing";
+            initialize();
+        }
+        timer.start();
+
+        // branch and fan values may have changed (e.g. from a script) since the last solve
+        m_program.gather( m_ventNet );
+        if( m_reduction.isReduced() ) {
+            m_reduction.contract( m_flowList.data() );
+        }
+
+        // dead ends carry nothing, whatever flow they were given
+        QVector<int>::const_iterator itPruned;
+        for( itPruned = m_pruned.begin(); itPruned != m_pruned.end(); itPruned++ ) {
+            m_flowList[ *itPruned ] = 0.f;
+        }
+    }
+
+    if( m_method == NewtonRaphson ) {
+        m_iterations = solveNewtonRaphson( meshCorrectionTolerance, iterationMax );
+    } else if( m_method == HardyCross ) {
+        m_iterations = solveHardyCross( meshCorrectionTolerance, iterationMax, lambda );
+    }
+
+    if( m_method != JunctionPressure ) {
+        // imbalance of the flows handed back, and the meshes holding most of it
+        const int nWorst = 5;
+        QVector<double> meshImbalance( m_program.nMeshBalanced );
+        double imbalance = 0.;
+        for( int i = 0; i < meshImbalance.count(); i++ ) {
+            meshImbalance[ i ] = fabs( pressureAdjustMesh<float,double>( m_flowList.constData(), m_program, i ).pressure );
+            imbalance += meshImbalance[ i ];
+        }
+        m_statistics.imbalance = imbalance;
+        m_statistics.rankMeshes( meshImbalance, nWorst );
+
+        if( m_reduction.isReduced() ) {
+            m_reduction.expand( m_flowList.data() );
+        }
+        m_statistics.iterationTime = timer.nsecsElapsed() * 1e-6;
+    }
+    m_statistics.iterations = m_iterations;
+    m_statistics.converged = ( m_iterations != iterationMax );
+
+    if( m_method == HardyCross && m_adaptiveLambda ) {
+        qCDebug( xmVentLog ) << "Adaptive lambda:" << m_lambda << "mesh lambda:" << m_meshLambda;
+    }
+
+    if( m_iterations != iterationMax ) {
+        qCDebug( xmVentLog ) << "Solution found after iteration" << m_iterations;
+    } else {
+        qCDebug( xmVentLog ) << "Did not achieve convergence criteria after iteration" << m_iterations;
+    }
+
+    return m_iterations == iterationMax;
+}
+
+
+/// Ventilation Solver valid so long as mesh does not change.
+XMVentSolveHC::XMVentSolveHC( QObject* parent, XMVentNetwork* ventNet ) : QObject( parent ), m_ventNet( ventNet )
+{
+    m_method = HardyCross;
+    m_acceleration = NoAcceleration;
+    m_accelerationDepth = 5;
+    m_adaptiveLambda = false;
+    m_lambda = 1.5f;
+    m_meshColoring = false;
+    m_threadCount = 0;
+    m_precision = Single;
+    m_incremental = false;
+    m_reduce = false;
+    m_threadPool = 0;
+    m_iterations = 0;
+}
+
+
+XMVentSolveHC::Method XMVentSolveHC::method() const
+{
+    return m_method;
+}
+
+
+void XMVentSolveHC::setMethod( Method method )
+{
+    m_method = method;
+}
+
+
+XMVentSolveHC::Acceleration XMVentSolveHC::acceleration() const
+{
+    return m_acceleration;
+}
+
+
+void XMVentSolveHC::setAcceleration( Acceleration acceleration )
+{
+    m_acceleration = acceleration;
+}
+
+
+/// Anderson history depth
+int XMVentSolveHC::accelerationDepth() const
+{
+    return m_accelerationDepth;
+}
+
+
+void XMVentSolveHC::setAccelerationDepth( int depth )
+{
+    m_accelerationDepth = qMax( depth, 1 );
+}
+
+
+bool XMVentSolveHC::adaptiveLambda() const
+{
+    return m_adaptiveLambda;
+}
+
+
+void XMVentSolveHC::setAdaptiveLambda( bool adaptive )
+{
+    m_adaptiveLambda = adaptive;
+}
+
+
+/// over-relaxation used by the last HardyCross solve (final value if adaptive)
+float XMVentSolveHC::lambda() const
+{
+    return m_lambda;
+}
+
+
+/// effective lambda of each balanced mesh after the last adaptive solve
+QVariantList XMVentSolveHC::getMeshLambda() const
+{
+    QVariantList r;
+    r.reserve( m_meshLambda.size() );
+    for( int i = 0; i < m_meshLambda.size(); i++ ) {
+        r.append( m_lambda * m_meshLambda[i] );
+    }
+
+    return r;
+}
+
+
+bool XMVentSolveHC::meshColoring() const
+{
+    return m_meshColoring;
+}
+
+
+void XMVentSolveHC::setMeshColoring( bool coloring )
+{
+    m_meshColoring = coloring;
+}
+
+
+/// threads of the colored or block Hardy-Cross sweep, 0 for one per core
+int XMVentSolveHC::threadCount() const
+{
+    return m_threadCount;
+}
+
+
+void XMVentSolveHC::setThreadCount( int count )
+{
+    m_threadCount = qMax( count, 0 );
+}
+
+
+XMVentSolveHC::Precision XMVentSolveHC::precision() const
+{
+    return m_precision;
+}
+
+
+void XMVentSolveHC::setPrecision( Precision precision )
+{
+    m_precision = precision;
+}
+
+
+bool XMVentSolveHC::reduction() const
+{
+    return m_reduce;
+}
+
+
+/// takes effect at the next initialize()
+void XMVentSolveHC::setReduction( bool reduce )
+{
+    m_reduce = reduce;
+}
+
+
+/// branches found in no closed path by the last initialize(), their flow is zero
+QVariantList XMVentSolveHC::getPrunedBranches() const
+{
+    QVariantList r;
+    QVector<int> branch;
+    QVector<int>::const_iterator itPruned;
+    for( itPruned = m_pruned.begin(); itPruned != m_pruned.end(); itPruned++ ) {
+        if( m_reduction.isReduced() && m_reduction.branchRoot[ *itPruned ] >= 0 ) {
+            m_reduction.leaves( m_reduction.nBranches + m_reduction.root[ m_reduction.branchRoot[*itPruned] ], branch );
+        } else {
+            branch.fill( *itPruned, 1 );
+        }
+        for( int k = 0; k < branch.count(); k++ ) {
+            r.append( branch[k] );
+        }
+    }
+
+    return r;
+}
+
+
+QString XMVentSolveHC::meshCache() const
+{
+    return m_meshCache;
+}
+
+
+/// meshes are looked up in and saved to this directory at initialize()
+void XMVentSolveHC::setMeshCache( const QString& directory )
+{
+    m_meshCache = directory;
+}
+
+
+bool XMVentSolveHC::incremental() const
+{
+    return m_incremental;
+}
+
+
+void XMVentSolveHC::setIncremental( bool incremental )
+{
+    m_incremental = incremental;
+}
+
+
+/// number of iterations used by the last solve()
+int XMVentSolveHC::iterations() const
+{
+    return m_iterations;
+}
+
+
+/// iterations, residual history, worst meshes and timings of the last solve
+const XMVentSolveHCStatistics& XMVentSolveHC::statistics() const
+{
+    return m_statistics;
+}
+
+
+QVariantMap XMVentSolveHC::getStatistics() const
+{
+    return m_statistics.toVariantMap();
+}
+
+
+int XMVentSolveHC::historyLength() const
+{
+    return m_statistics.historyLength;
+}
+
+
+/// most residual history values kept per solve, 0 to keep none
+void XMVentSolveHC::setHistoryLength( int length )
+{
+    m_statistics.historyLength = qMax( length, 0 );
+}
+
+
+QString XMVentSolveHC::statisticsJson() const
+{
+    return QString::fromUtf8( m_statistics.toJson() );
+}
+
+
+void XMVentSolveHC::initialize()
+{
+    // reset all structures
+    m_meshList.clear();
+    m_flowList.clear();
+    m_program.clear();
+    m_jacobian.clear();
+    m_nodal.clear();
+    m_pressureList.clear();
+    m_flowDouble.clear();
+    m_solved.clear();
+
+    // collapse series and parallel branches
+    m_reduction.clear();
+    if( m_reduce ) {
+        m_reduction.build( m_ventNet );
+        m_reduction.evaluate( m_ventNet );
+    }
+    m_program.reduction = ( m_reduction.isReduced() ? &m_reduction : 0 );
+
+    // find mesh and mesh direction coefficients, reusing the meshes saved for
+    // an earlier network of the same topology.  Those stay valid meshes even
+    // if the resistances would now pick another spanning tree.
+    QElapsedTimer timer;
+    timer.start();
+    m_statistics.graphTime = 0.;
+    QString cacheFile;
+    if( !m_meshCache.isEmpty() && QDir().mkpath( m_meshCache ) ) {
+        cacheFile = QDir( m_meshCache ).filePath( QString::fromLatin1( topologyKey().toHex() ) + ".mesh" );
+    }
+    bool found = false;
+    if( !m_meshData.isEmpty() ) {
+        QBuffer buffer( &m_meshData );
+        buffer.open( QIODevice::ReadOnly );
+        QDataStream in( &buffer );
+        found = readMesh( in );
+    }
+    if( !found && ( cacheFile.isEmpty() || !loadMesh( cacheFile ) ) ) {
+        createMesh();
+        if( !cacheFile.isEmpty() ) {
+            saveMesh( cacheFile );
+        }
+    }
+    m_program.compile( m_meshList, m_ventNet->m_fixedFlow.count() );
+    m_statistics.meshTime = timer.nsecsElapsed() * 1e-6 - m_statistics.graphTime;
+
+    // initialize flow
+    flowInitialize();
+    if( m_reduction.isReduced() ) {
+        m_reduction.expand( m_flowList.data() );
+    }
+    qCDebug( xmVentLog ) << "Initialized flow:" << m_flowList;
+}
+
+
+/// restart from the initial mesh flows, e.g. after fixed flows have changed
+void XMVentSolveHC::resetFlow()
+{
+    if( m_meshList.count() == 0 ) {
+        initialize();
+        return;
+    }
+    m_solved.clear();
+    flowInitialize();
+    if( m_reduction.isReduced() ) {
+        m_reduction.expand( m_flowList.data() );
+    }
+}
+
+
+/// take the solution settings of other; the meshes and flows are not copied
+void XMVentSolveHC::copySettings( const XMVentSolveHC& other )
+{
+    m_method = other.m_method;
+    m_acceleration = other.m_acceleration;
+    m_accelerationDepth = other.m_accelerationDepth;
+    m_adaptiveLambda = other.m_adaptiveLambda;
+    m_meshColoring = other.m_meshColoring;
+    m_threadCount = other.m_threadCount;
+    m_precision = other.m_precision;
+    m_incremental = other.m_incremental;
+    m_reduce = other.m_reduce;
+    m_meshCache = other.m_meshCache;
+    m_statistics.historyLength = other.m_statistics.historyLength;
+}
+
+
+/// solve a copy of the network for each assignment, see XMVentSweep::run()
+QVariantList XMVentSolveHC::sweep( const QVariantList& assignments, float meshCorrectionTolerance,
+                                   int iterationMax, float lambda )
+{
+    QList<QVariantMap> assignment;
+    for( int i = 0; i < assignments.count(); i++ ) {
+        assignment.append( assignments[i].toMap() );
+    }
+
+    return XMVentSweep::run( m_ventNet, assignment, meshCorrectionTolerance, iterationMax, lambda, m_threadCount );
+}
+
+
+/// sweep every combination of the value lists, e.g.
+/// { "fan:main_fan": [ 1000, 1100 ], "fan:booster_fan": [ 100, 200, 300 ] }
+QVariantList XMVentSolveHC::sweepGrid( const QVariantMap& values, float meshCorrectionTolerance,
+                                       int iterationMax, float lambda )
+{
+    return XMVentSweep::run( m_ventNet, XMVentSweep::grid( values ), meshCorrectionTolerance, iterationMax,
+                             lambda, m_threadCount );
+}
+
+
+QVariantList XMVentSolveHC::getFlow() const
+{
+    QVariantList r;
+
+    // Available in Qt5.6
+    // QList<float>::reverse_iterator it;
+
+    for( int i = m_flowList.size()-1; i>=0; i-- ) {
+        r.append( m_flowList[i] );
+    }
+
+    return r;
+}
+
+
+void XMVentSolveHC::setFlow( const QVariantList& flow )
+{
+    QVector<float> r;
+    r.reserve( flow.size() );
     for( int i = flow.size()-1; i>=0; i-- ) {
         r.append( flow[i].toFloat() );
     }
     m_flowList = r;
 }
 
+
+/// junction pressures [Pa] of the last JunctionPressure solution
+QVariantList XMVentSolveHC::getPressure() const
+{
+    QVariantList r;
+    r.reserve( m_pressureList.size() );
+    for( int i = 0; i < m_pressureList.size(); i++ ) {
+        r.append( m_pressureList[i] );
+    }
+
+    return r;
+}
+
 /// returns a list of booster fsp [Pa] (positive); or resistance [Ns2/m8] (negative)
 QVariantList XMVentSolveHC::fixedFlowPressure() const
 {
     QVariantList fixedFlowPressure;
 
-    int nMeshBalance = m_meshList.count() - m_ventNet->m_fixedFlow.count();
+    if( m_method == JunctionPressure ) {
+        // branch pressure loss less fan and junction pressure drop
+        QMap<int, float>::const_iterator itFixedFlow;
+        for( itFixedFlow = m_ventNet->m_fixedFlow.begin(); itFixedFlow != m_ventNet->m_fixedFlow.end(); itFixedFlow++ ) {
+            const int b = itFixedFlow.key();
+            if( b >= m_nodal.branchKind.count() ) {
+                break;
+            }
+            float q = itFixedFlow.value();
+            double fanSlope;
+            float pressure = m_nodal.branchResistance[b] * pow( fabs(q), m_nodal.branchN[b] - 1.f ) * q
+                             - m_nodal.fanPressure( b, q, fanSlope )
+                             - ( m_nodal.nodePressure[ m_nodal.branchFrom[b] ] - m_nodal.nodePressure[ m_nodal.branchTo[b] ] );
+            if( pressure < 0 ) {
+                // calculate regulator resistance
+                pressure /= q * q;
+            }
+            fixedFlowPressure.append( pressure );
+        }
+        return fixedFlowPressure;
+    }
+
+    if( m_reduction.isReduced() ) {
+        m_reduction.evaluate( m_ventNet );
+    }
+    m_program.gather( m_ventNet );
+
+    // the meshes see the flows of the reduced branches
+    QVector<float> flow( m_flowList );
+    if( m_reduction.isReduced() ) {
+        m_reduction.contract( flow.data() );
+    }
+
     QMap<int, float>::const_iterator itFixedFlow = m_ventNet->m_fixedFlow.begin();
-    for( int i = nMeshBalance; i < m_meshList.count(); i++, itFixedFlow++ ) { // for each fixed-flow branch
-        QList<XMVentSolveHCStep> mesh = m_meshList[i];
+    for( int i = m_program.nMeshBalanced; i < m_program.meshCount(); i++, itFixedFlow++ ) { // for each fixed-flow branch
         // calculate correction
-        MeshAdjust adj = pressureAdjustBranch( m_flowList, mesh, m_ventNet->m_branch, m_ventNet->m_fanList );
+        MeshAdjust<double> adj;
+        if( m_precision == Double && m_flowDouble.count() == m_flowList.count() ) {
+            adj = pressureAdjustMesh<double,double>( m_flowDouble.constData(), m_program, i );
+        } else {
+            adj = pressureAdjustMesh<float,double>( flow.constData(), m_program, i );
+        }
 
         if( adj.pressure < 0 ) {
             // calculate regulator resistance
@@ -560,4 +3419,207 @@ void XMVentSolveHC::clear()
 {
     m_meshList.clear();
     m_flowList.clear();
+    m_program.clear();
+    m_jacobian.clear();
+    m_nodal.clear();
+    m_pressureList.clear();
+    m_flowDouble.clear();
+    m_solved.clear();
+    m_reduction.clear();
+    m_program.reduction = 0;
+    m_pruned.clear();
+    m_meshData.clear();
+}
+
+
+/// compile the plain meshes and the current branch parameters into a model
+/// that scenarios on any thread can share
+QSharedPointer<const XMVentSolveHCModel> XMVentSolveHC::model()
+{
+    // a reducing solver has other meshes; find the plain ones apart
+    XMVentSolveHC plain( 0, m_ventNet );
+    XMVentSolveHC* source = this;
+    if( m_reduce || m_reduction.isReduced() ) {
+        plain.copySettings( *this );
+        plain.m_reduce = false;
+        source = &plain;
+    }
+    if( source->m_meshList.count() == 0 ) {
+        source->initialize();
+    }
+
+    XMVentSolveHCModel* model = new XMVentSolveHCModel;
+    const int nBranches = m_ventNet->m_branch.count();
+    model->nBranches = nBranches;
+    model->program = source->m_program;
+    model->program.reduction = 0;
+    model->program.gather( m_ventNet );
+    model->pruned = source->m_pruned;
+
+    // steps of each branch, after gather() has put them in kernel order
+    const XMVentSolveHCProgram& program = model->program;
+    model->branchStepOffset.fill( 0, nBranches + 1 );
+    for( int k = 0; k < program.stepCount(); k++ ) {
+        model->branchStepOffset[ program.stepBranch[k] + 1 ]++;
+    }
+    for( int b = 0; b < nBranches; b++ ) {
+        model->branchStepOffset[ b + 1 ] += model->branchStepOffset[ b ];
+    }
+    model->branchStep.resize( program.stepCount() );
+    QVector<int> next( model->branchStepOffset );
+    for( int k = 0; k < program.stepCount(); k++ ) {
+        model->branchStep[ next[ program.stepBranch[k] ]++ ] = k;
+    }
+
+    model->branchFan.fill( -1, nBranches );
+    QMap<int,XMVentFan*>::const_iterator itFan;
+    for( itFan = m_ventNet->m_fanList.begin(); itFan != m_ventNet->m_fanList.end(); itFan++ ) {
+        model->branchFan[ itFan.key() ] = m_ventNet->m_fanDefinition.indexOf( itFan.value() );
+    }
+
+    QMap<int, float>::const_iterator itFixedFlow;
+    for( itFixedFlow = m_ventNet->m_fixedFlow.begin(); itFixedFlow != m_ventNet->m_fixedFlow.end(); itFixedFlow++ ) {
+        model->fixedFlowBranch.append( itFixedFlow.key() );
+        model->fixedFlow.append( itFixedFlow.value() );
+    }
+
+    return QSharedPointer<const XMVentSolveHCModel>( model );
+}
+
+
+XMVentSolveHCScenario::XMVentSolveHCScenario( QSharedPointer<const XMVentSolveHCModel> model ) :
+    m_model( model ), m_precision( XMVentSolveHC::Single ), m_iterations( 0 ), m_meshCorrection( 0. )
+{
+    reset();
+}
+
+
+/// back to the parameters of the model, sharing its arrays again
+void XMVentSolveHCScenario::reset()
+{
+    m_program = m_model->program;
+    m_fixedFlow = m_model->fixedFlow;
+}
+
+
+void XMVentSolveHCScenario::setResistance( int branch, float resistance )
+{
+    for( int k = m_model->branchStepOffset[ branch ]; k < m_model->branchStepOffset[ branch + 1 ]; k++ ) {
+        m_program.stepResistance[ m_model->branchStep[k] ] = resistance;
+    }
+}
+
+
+/// fixed pressure of a fan definition, on every branch it is fitted to.
+/// Like XMVentFan, a fan with a characteristic ignores its fixed pressure.
+void XMVentSolveHCScenario::setFanPressure( int fan, float pressure )
+{
+    if( !m_program.fanCurve.value( fan ).isEmpty() ) {
+        return;
+    }
+    for( int b = 0; b < m_model->nBranches; b++ ) {
+        if( m_model->branchFan[b] != fan ) {
+            continue;
+        }
+        for( int k = m_model->branchStepOffset[ b ]; k < m_model->branchStepOffset[ b + 1 ]; k++ ) {
+            const int step = m_model->branchStep[ k ];
+            m_program.stepFanPressure[ step ] = m_program.stepDirection[ step ] * pressure;
+        }
+    }
+}
+
+
+/// false if the branch has no fixed flow
+bool XMVentSolveHCScenario::setFixedFlow( int branch, float flow )
+{
+    const int i = m_model->fixedFlowBranch.indexOf( branch );
+    if( i < 0 ) {
+        return false;
+    }
+    m_fixedFlow[ i ] = flow;
+    return true;
+}
+
+
+void XMVentSolveHCScenario::setPrecision( XMVentSolveHC::Precision precision )
+{
+    m_precision = precision;
+}
+
+
+/// plain Hardy-Cross iteration of one program
+template<typename Flow, typename Real>
+static int ventSolveHCPlain( Flow* flow, const XMVentSolveHCProgram& program, float meshCorrectionTolerance,
+                             int iterationMax, float lambda, double& meshCorrection )
+{
+    Real correction = +INFINITY;
+    int i;
+    for( i = 0; (i < iterationMax) && (correction > meshCorrectionTolerance); i++ ) {
+        correction = ventSolveHCIterate<Flow,Real>( flow, program, lambda );
+    }
+    meshCorrection = correction;
+
+    return i;
+}
+
+
+/// solve from the initial mesh flows; true on failure as XMVentSolveHC::solve()
+bool XMVentSolveHCScenario::solve( float meshCorrectionTolerance, int iterationMax, float lambda )
+{
+    // initial flows: 1 around each balanced mesh, the fixed flow around the others
+    const XMVentSolveHCProgram& program = m_program;
+    m_flowList.fill( 0.f, m_model->nBranches );
+    for( int i = 0; i < program.meshCount(); i++ ) {
+        const float q = ( i < program.nMeshBalanced ? 1.f : m_fixedFlow[ i - program.nMeshBalanced ] );
+        for( int k = program.meshOffset[i]; k < program.meshOffset[i+1]; k++ ) {
+            m_flowList[ program.stepBranch[k] ] += q * program.stepDirection[k];
+        }
+    }
+
+    m_flowDouble.clear();
+    if( m_precision == XMVentSolveHC::Single ) {
+        m_iterations = ventSolveHCPlain<float,float>( m_flowList.data(), program, meshCorrectionTolerance,
+                                                      iterationMax, lambda, m_meshCorrection );
+    } else if( m_precision == XMVentSolveHC::Mixed ) {
+        m_iterations = ventSolveHCPlain<float,double>( m_flowList.data(), program, meshCorrectionTolerance,
+                                                       iterationMax, lambda, m_meshCorrection );
+    } else {
+        m_flowDouble.resize( m_flowList.count() );
+        for( int b = 0; b < m_flowList.count(); b++ ) {
+            m_flowDouble[ b ] = m_flowList[ b ];
+        }
+        m_iterations = ventSolveHCPlain<double,double>( m_flowDouble.data(), program, meshCorrectionTolerance,
+                                                        iterationMax, lambda, m_meshCorrection );
+        for( int b = 0; b < m_flowList.count(); b++ ) {
+            m_flowList[ b ] = m_flowDouble[ b ];
+        }
+    }
+
+    return m_iterations == iterationMax;
+}
+
+
+/// as XMVentSolveHC::fixedFlowPressure(): booster fsp [Pa] (positive) or
+/// regulator resistance [Ns2/m8] (negative) of each fixed flow branch
+QVariantList XMVentSolveHCScenario::fixedFlowPressure() const
+{
+    QVariantList fixedFlowPressure;
+    for( int i = m_program.nMeshBalanced; i < m_program.meshCount(); i++ ) {
+        MeshAdjust<double> adj;
+        if( m_flowDouble.count() == m_flowList.count() ) {
+            adj = pressureAdjustMesh<double,double>( m_flowDouble.constData(), m_program, i );
+        } else {
+            adj = pressureAdjustMesh<float,double>( m_flowList.constData(), m_program, i );
+        }
+
+        if( adj.pressure < 0 ) {
+            // calculate regulator resistance
+            float q = m_fixedFlow[ i - m_program.nMeshBalanced ];
+            adj.pressure /= q * q;
+        }
+
+        fixedFlowPressure.append( adj.pressure );
+    }
+
+    return fixedFlowPressure;
 }
@@ -25,11 +25,18 @@
 #define XMVENTSOLVEHC_H
 
 #include "xmvent-global.h"
+#include "sparse.h"
+#include "meshkernel.h"
+#include "fan.h"
+#include "statistics.h"
 
 #include <QObject>
 #include <QMultiMap>
 #include <QVector>
 #include <QVariantList>
+#include <QVariantMap>
+#include <QString>
+#include <QSharedPointer>
 
 
 /// Defines a single step while walking through the network
@@ -40,35 +47,439 @@ struct XMVentSolveHCStep {
 };
 
 
+/// Branch end points seen by the mesh search: the network itself or its
+/// series / parallel reduction, with all surface junctions merged into one
+/// atmosphere node.  Branches hidden by the reduction or pruned have end
+/// points of -1.
+struct XMVentSolveHCGraph {
+    int nJunctions;
+    QVector<int> branchFrom, branchTo;
+    QVector<float> branchResistance;
+
+    XMVentSolveHCGraph() : nJunctions( 0 ) {}
+
+    int branchCount() const { return branchFrom.count(); }
+    bool hasBranch( int b ) const { return branchFrom[b] >= 0; }
+
+    static QVector<int> junctionNodes( const class XMVentNetwork* net );
+};
+
+
+/// Junction adjacency of a graph in compressed rows, built once per topology.
+/// The steps leaving junction j are step[ offset[j], offset[j+1] ), in branch
+/// order, each branch appearing once from either end.
+struct XMVentSolveHCAdjacency {
+    QVector<int> offset;
+    QVector<XMVentSolveHCStep> step;
+
+    void build( const XMVentSolveHCGraph& g );
+
+    int degree( int j ) const { return offset[j+1] - offset[j]; }
+    const XMVentSolveHCStep* begin( int j ) const { return step.constData() + offset[j]; }
+    const XMVentSolveHCStep* end( int j ) const { return step.constData() + offset[j+1]; }
+};
+
+
+/// Meshes in compressed rows: mesh i is step[ offset[i], offset[i+1] ).  All
+/// meshes share the two arrays, so clear() costs the same for any number of
+/// meshes and a later createMesh() reuses their capacity.
+struct XMVentSolveHCMeshList {
+    QVector<int> offset;
+    QVector<XMVentSolveHCStep> step;
+
+    XMVentSolveHCMeshList() : offset( 1, 0 ) {}
+
+    int count() const { return offset.count() - 1; }
+    bool isEmpty() const { return count() == 0; }
+    int stepCount( int i ) const { return offset[i+1] - offset[i]; }
+    const XMVentSolveHCStep* begin( int i ) const { return step.constData() + offset[i]; }
+    const XMVentSolveHCStep* end( int i ) const { return step.constData() + offset[i+1]; }
+
+    void append( const XMVentSolveHCStep& s ) { step.append( s ); }
+    void closeMesh() { offset.append( step.count() ); }     // the steps since the last closeMesh() form a mesh
+    void clear() { offset.resize( 1 ); step.clear(); }
+};
+
+
+/// Bridges and biconnected blocks of a graph (Tarjan).  A bridge is in no
+/// mesh and carries no flow; every mesh lies within a single block.
+struct XMVentSolveHCTopology {
+    QVector<int> branchBlock;           // block of each branch, -1 for bridges and hidden branches
+    QVector<bool> bridge;
+    int nBlocks;
+    int nBridges;
+
+    XMVentSolveHCTopology() : nBlocks( 0 ), nBridges( 0 ) {}
+
+    void analyze( const XMVentSolveHCGraph& g, const XMVentSolveHCAdjacency& adj );
+};
+
+
+/// Series chains and parallel groups of plain branches (same n, no fan, no
+/// fixed flow) collapsed into equivalent branches.  Items [0,nBranches) are
+/// the network branches, item nBranches+c is composite c; children always
+/// come before their parent.  Each top level composite is solved in place of
+/// one of its branches, its representative.
+struct XMVentSolveHCReduction {
+    enum Kind { Series, Parallel };
+
+    int nBranches, nJunctions;
+    QVector<char> kind;                 // per composite
+    QVector<int> childOffset;           // composite -> range in child / childSign
+    QVector<int> child;
+    QVector<qint8> childSign;           // child direction relative to the composite
+    QVector<int> itemFrom, itemTo;      // end points of every item
+    QVector<int> branchRoot;            // representative branch -> top level composite, -1 otherwise
+    QVector<int> root;                  // top level composites
+    QVector<int> rootBranch;            // representative of each top level composite
+
+    // refreshed by evaluate()
+    QVector<float> resistance, n;       // per composite
+    QVector<float> branchResistance;    // per branch, for the parallel flow split
+
+    // flows written by the last expand(), to undo it exactly
+    QVector<float> expandedFlow;
+    QVector<float> rootFlow;
+
+    XMVentSolveHCReduction() : nBranches( 0 ), nJunctions( 0 ) {}
+
+    void build( const class XMVentNetwork* net );
+    bool evaluate( const class XMVentNetwork* net );
+    void graph( XMVentSolveHCGraph& g ) const;
+    void contract( float* flow ) const;
+    void expand( float* flow );
+    void leaves( int item, QVector<int>& branch ) const;
+    void clear();
+
+    bool isReduced() const { return !root.isEmpty(); }
+    int compositeCount() const { return kind.count(); }
+    int hiddenCount() const;
+};
+
+
+/// Flattened (CSR) form of the mesh list used by the iteration hot loop.
+/// Mesh i covers steps [meshOffset[i], meshOffset[i+1]).  Branch parameters
+/// are gathered per step into separate arrays so the iteration never touches
+/// the XMVentBranch / XMVentFan objects.
+struct XMVentSolveHCProgram {
+    int nMeshBalanced;              // meshes [0,nMeshBalanced) are iterated, the rest are fixed-flow
+    QVector<int> meshOffset;        // meshCount()+1 offsets into the step arrays
+    QVector<int> stepBranch;        // branch index of each step
+    QVector<qint8> stepDirection;   // +1 / -1 branch direction relative to the mesh
+
+    // per-step branch parameters, refreshed by gather()
+    QVector<float> stepResistance;
+    QVector<float> stepN;
+    QVector<float> stepFanPressure; // fan pressure signed by step direction
+    QVector<int> meshLawOffset;     // 2 per mesh: end of the n == 2 steps, end of the n == 1 steps
+
+    // fans with a characteristic add pressure and dP/dQ at the current flow.
+    // Their steps have no fixed fan pressure; mesh i has the curve steps
+    // curveStep[ meshCurveOffset[i], meshCurveOffset[i+1] ).  All empty without curves.
+    QVector<XMVentFanCurve> fanCurve;   // per fan definition, empty for a fixed pressure fan
+    QVector<int> meshCurveOffset;
+    QVector<int> curveStep;
+    QVector<int> curveFan;              // fan definition of each curve step
+
+    const XMVentMeshKernel* kernel; // vector kernels for this CPU
+    const XMVentSolveHCReduction* reduction; // equivalent branch parameters, 0 if not reduced
+
+    // balanced meshes of each branch, from incidence()
+    QVector<int> branchMeshOffset;
+    QVector<int> branchMesh;
+
+    // balanced meshes of each biconnected block are contiguous: block -> mesh range
+    QVector<int> blockOffset;
+
+    // balanced meshes grouped so that no two meshes of a color share a branch, from color()
+    QVector<int> colorOffset;       // color -> range in colorMesh
+    QVector<int> colorMesh;
+
+    XMVentSolveHCProgram();
+
+    void compile( const XMVentSolveHCMeshList& meshList, int nFixedFlow );
+    void gather( const class XMVentNetwork* net );
+    void incidence();
+    void color();
+    void clear();
+
+    int meshCount() const { return meshOffset.count() - 1; }
+    int stepCount() const { return stepBranch.count(); }
+    XMVentMeshSteps steps() const;
+};
+
+
+/// Compiled network shared by concurrent scenario solves: the plain (unreduced)
+/// meshes with the branch parameters gathered when XMVentSolveHC::model()
+/// built it.  Nothing changes it afterwards, so any number of threads may use
+/// it without locks.
+struct XMVentSolveHCModel {
+    int nBranches;
+    XMVentSolveHCProgram program;
+    QVector<int> branchStepOffset;      // branch -> range in branchStep, all meshes
+    QVector<int> branchStep;
+    QVector<int> branchFan;             // fan definition index of each branch, -1 for none
+    QVector<float> fixedFlow;           // in fixed-flow mesh order
+    QVector<int> fixedFlowBranch;
+    QVector<int> pruned;
+
+    XMVentSolveHCModel() : nBranches( 0 ) {}
+};
+
+
+/// Branch parameters and flows of the last converged Hardy-Cross solve, used
+/// to find what changed before an incremental re-solve
+struct XMVentSolveHCSnapshot {
+    bool valid;
+    QVector<int> stepBranch;
+    QVector<float> stepResistance, stepN, stepFanPressure;
+    QVector<XMVentFanCurve> fanCurve;
+    QVector<float> fixedFlow;           // in fixed-flow mesh order
+    QVector<float> flow;
+
+    XMVentSolveHCSnapshot() : valid( false ) {}
+    void clear();
+};
+
+
+/// Loop Jacobian J = C diag(dP/dQ) C' of the balanced meshes for the
+/// Newton-Raphson mode.  Pattern, scatter map and ordering depend only on the
+/// meshes and are built once; assemble() refills the values each iteration.
+struct XMVentSolveHCJacobian {
+    QVector<int> branchOffset;          // branch -> range in branchMesh / branchDirection
+    QVector<int> branchMesh;            // balanced meshes containing the branch
+    QVector<qint8> branchDirection;
+    QVector<int> branchScatter;         // matrix.value index of each (mesh, mesh) pair of a branch
+    XMVentSparseMatrix matrix;
+    XMVentSparseLDL factor;
+
+    void build( const XMVentSolveHCProgram& program, int nBranches );
+    void assemble( const double* branchSlope );
+    void clear();
+};
+
+
+/// Junction pressure (Kirchhoff I) system for the JunctionPressure mode.
+/// Zero resistance branches without a fan and all surface junctions are
+/// contracted into single nodes.  Nodes holding a reference pressure are
+/// fixed; every other node is an unknown of the conductance matrix.
+struct XMVentSolveHCNodal {
+    QVector<int> junctionNode;          // junction -> node
+    QVector<int> nodeUnknown;           // node -> matrix row, -1 for a reference node
+    QVector<double> nodePressure;       // reference or solved pressure of each node
+    QVector<int> branchFrom, branchTo;  // branch end nodes
+    QVector<char> branchKind;           // Free, Fixed or Contracted
+    QVector<int> branchScatter;         // 4 matrix.value indices per branch (uu, vv, uv, vu) or -1
+    QVector<int> treeBranch, treeChild; // contracted branches in leaves-first order
+    QVector<float> branchResistance, branchN, branchFanPressure;
+    QVector<int> branchCurve;           // fan definition with a characteristic, or -1
+    QVector<XMVentFanCurve> fanCurve;
+    XMVentSparseMatrix matrix;
+    XMVentSparsePCG pcg;
+
+    enum BranchKind { Free, Fixed, Contracted };
+
+    /// fan pressure of branch b at flow q, dP/dQ in slope
+    double fanPressure( int b, double q, double& slope ) const {
+        slope = 0.;
+        return branchCurve[b] < 0 ? double( branchFanPressure[b] ) : fanCurve[ branchCurve[b] ].pressure( q, slope );
+    }
+
+    void build( const class XMVentNetwork* net );
+    bool gather( const class XMVentNetwork* net );
+    void recoverContractedFlow( const class XMVentNetwork* net, float* flow ) const;
+    void clear();
+};
+
+
 /// Hardy-Cross Ventilation Network Solver
 class XMVENTSHARED_EXPORT XMVentSolveHC : public QObject
 {
     Q_OBJECT
+    Q_ENUMS( Method Acceleration Precision )
     Q_PROPERTY( QVariantList flow READ getFlow WRITE setFlow )
+    Q_PROPERTY( Method method READ method WRITE setMethod )
+    Q_PROPERTY( Acceleration acceleration READ acceleration WRITE setAcceleration )
+    Q_PROPERTY( int accelerationDepth READ accelerationDepth WRITE setAccelerationDepth )
+    Q_PROPERTY( bool adaptiveLambda READ adaptiveLambda WRITE setAdaptiveLambda )
+    Q_PROPERTY( float lambda READ lambda )
+    Q_PROPERTY( QVariantList meshLambda READ getMeshLambda )
+    Q_PROPERTY( bool meshColoring READ meshColoring WRITE setMeshColoring )
+    Q_PROPERTY( int threadCount READ threadCount WRITE setThreadCount )
+    Q_PROPERTY( Precision precision READ precision WRITE setPrecision )
+    Q_PROPERTY( bool incremental READ incremental WRITE setIncremental )
+    Q_PROPERTY( bool reduction READ reduction WRITE setReduction )
+    Q_PROPERTY( QVariantList prunedBranches READ getPrunedBranches )
+    Q_PROPERTY( QString meshCache READ meshCache WRITE setMeshCache )
+    Q_PROPERTY( int iterations READ iterations )
+    Q_PROPERTY( QVariantMap statistics READ getStatistics )
+    Q_PROPERTY( int historyLength READ historyLength WRITE setHistoryLength )
+    Q_PROPERTY( QVariantList pressure READ getPressure )
+
+public:
+    /// HardyCross corrects one mesh at a time, NewtonRaphson corrects all meshes
+    /// simultaneously and JunctionPressure solves for junction pressures without meshes
+    enum Method { HardyCross, NewtonRaphson, JunctionPressure };
+
+    /// extrapolation of the HardyCross iterates, steps that increase the
+    /// mesh imbalance are rejected in favour of the plain iterate
+    enum Acceleration { NoAcceleration, Aitken, Anderson };
+
+    /// HardyCross arithmetic: float flows and sums, float flows with double
+    /// sums, or double flows and sums.  The other methods always use double.
+    enum Precision { Single, Mixed, Double };
 
 protected:
     class XMVentNetwork *m_ventNet;
-    QList<QList<XMVentSolveHCStep> > m_meshList;
+    XMVentSolveHCMeshList m_meshList;
+    mutable XMVentSolveHCProgram m_program;  // parameters are a cache of the network values
+    XMVentSolveHCJacobian m_jacobian;
+    XMVentSolveHCNodal m_nodal;
+    Method m_method;
+    Acceleration m_acceleration;
+    int m_accelerationDepth;
+    bool m_adaptiveLambda;
+    float m_lambda;                 // lambda of the last HardyCross solve
+    QVector<float> m_meshLambda;    // per-mesh factor of the last adaptive solve
+    bool m_meshColoring;            // sweep the meshes color by color, in parallel
+    int m_threadCount;              // colored or block sweep threads, 0 for one per core
+    class QThreadPool* m_threadPool;
+    QVector<double> m_meshPressure; // colored and block sweep workspace
+    Precision m_precision;
+    QVector<double> m_flowDouble;   // working flows of the Double precision
+    bool m_incremental;             // re-solve only around what changed since the last solution
+    XMVentSolveHCSnapshot m_solved;
+    bool m_reduce;                  // solve the series / parallel reduced network
+    mutable XMVentSolveHCReduction m_reduction;
+    QVector<int> m_pruned;          // branches in no mesh, held at zero flow
+    QString m_meshCache;            // directory of meshes saved by topology, empty for none
+    QByteArray m_meshData;          // meshes given with the network, see setMeshData()
+    int m_iterations;
+    XMVentSolveHCStatistics m_statistics;
 
     void createMesh();
+    void graph( XMVentSolveHCGraph& g ) const;
+    QByteArray topologyKey() const;
+    bool readMesh( class QDataStream& in );
+    void writeMesh( class QDataStream& out ) const;
+    bool loadMesh( const QString& fileName );
+    void saveMesh( const QString& fileName ) const;
     void flowInitialize();
+    template<typename Flow, typename Real>
+    Real sweep( Flow* flow, float lambda, double* meshStep = 0, const float* meshLambda = 0 );
+
+    int solveHardyCross( float meshCorrectionTolerance, int iterationMax, float lambda );
+    int solveHardyCrossPrecision( float meshCorrectionTolerance, int iterationMax, float lambda,
+                                  const QVector<int>* seed );
+    template<typename Flow, typename Real>
+    int solveHardyCross( Flow* flow, float meshCorrectionTolerance, int iterationMax, float lambda,
+                         const QVector<int>* seed );
+    template<typename Flow, typename Real>
+    int solveIncremental( Flow* flow, const QVector<int>& seed, float meshCorrectionTolerance,
+                          int iterationMax, float lambda, Real& meshCorrection );
+    bool changedMeshes( QVector<int>& seed );
+    void saveSolved();
+    int solveNewtonRaphson( float meshCorrectionTolerance, int iterationMax );
+    int solveJunctionPressure( float branchPressureTolerance, int iterationMax );
 
 public:
-    QList<float> m_flowList;
+    QVector<float> m_flowList;
+    QVector<float> m_pressureList;  // junction pressures from the JunctionPressure mode
 
     explicit XMVentSolveHC( QObject* parent, class XMVentNetwork* ventNet );
 
+    Method method() const;
+    void setMethod( Method method );
+    Acceleration acceleration() const;
+    void setAcceleration( Acceleration acceleration );
+    int accelerationDepth() const;
+    void setAccelerationDepth( int depth );
+    bool adaptiveLambda() const;
+    void setAdaptiveLambda( bool adaptive );
+    float lambda() const;
+    QVariantList getMeshLambda() const;
+    bool meshColoring() const;
+    void setMeshColoring( bool coloring );
+    int threadCount() const;
+    void setThreadCount( int count );
+    Precision precision() const;
+    void setPrecision( Precision precision );
+    bool incremental() const;
+    void setIncremental( bool incremental );
+    bool reduction() const;
+    void setReduction( bool reduce );
+    QVariantList getPrunedBranches() const;
+    QString meshCache() const;
+    void setMeshCache( const QString& directory );
+    QByteArray meshData() const;
+    void setMeshData( const QByteArray& data );
+    int iterations() const;
+    const XMVentSolveHCStatistics& statistics() const;
+    QVariantMap getStatistics() const;
+    int historyLength() const;
+    void setHistoryLength( int length );
+    Q_INVOKABLE QString statisticsJson() const;
+
+    void copySettings( const XMVentSolveHC& other );
+
     Q_INVOKABLE void initialize();
+    Q_INVOKABLE void resetFlow();
     Q_INVOKABLE bool solve( float meshCorrectionTolerance = 0.5f,
                             int iterationMax = 1000000,
                             float lambda = 1.5f );
 
     QVariantList getFlow() const;
     void setFlow( const QVariantList& flow );
+    QVariantList getPressure() const;
 
     Q_INVOKABLE void clear();
 
     Q_INVOKABLE QVariantList fixedFlowPressure() const;
+
+    Q_INVOKABLE QVariantList sweep( const QVariantList& assignments,
+                                    float meshCorrectionTolerance = 0.5f,
+                                    int iterationMax = 1000000,
+                                    float lambda = 1.5f );
+    Q_INVOKABLE QVariantList sweepGrid( const QVariantMap& values,
+                                        float meshCorrectionTolerance = 0.5f,
+                                        int iterationMax = 1000000,
+                                        float lambda = 1.5f );
+
+    QSharedPointer<const XMVentSolveHCModel> model();
+};
+
+
+/// One variant of a network solved on a shared XMVentSolveHCModel: its own
+/// flows, parameter overrides and statistics.  The step arrays are shared with
+/// the model until an override changes them.  Plain Hardy-Cross only; the
+/// accelerations, coloring and reduction stay with XMVentSolveHC.
+class XMVENTSHARED_EXPORT XMVentSolveHCScenario
+{
+protected:
+    QSharedPointer<const XMVentSolveHCModel> m_model;
+    XMVentSolveHCProgram m_program;
+    QVector<float> m_fixedFlow;
+    QVector<float> m_flowList;
+    QVector<double> m_flowDouble;
+    XMVentSolveHC::Precision m_precision;
+    int m_iterations;
+    double m_meshCorrection;
+
+public:
+    explicit XMVentSolveHCScenario( QSharedPointer<const XMVentSolveHCModel> model );
+
+    void reset();
+    void setResistance( int branch, float resistance );
+    void setFanPressure( int fan, float pressure );
+    bool setFixedFlow( int branch, float flow );
+    void setPrecision( XMVentSolveHC::Precision precision );
+
+    bool solve( float meshCorrectionTolerance = 0.5f, int iterationMax = 1000000, float lambda = 1.5f );
+
+    const QVector<float>& flow() const { return m_flowList; }
+    QVariantList fixedFlowPressure() const;
+    int iterations() const { return m_iterations; }
+    double meshCorrection() const { return m_meshCorrection; }
 };
 
 
@@ -0,0 +1,534 @@
+/*
+ *  Copyright (C) 2010 Andrew Wilson.
+ *  All rights reserved.
+ *  Contact email: amwgeo@gmail.com
+ *
+ *  This file is part of xmlMine-Vent
+ *
+ *  xmlMine-Vent is free software: you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation, either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  xmlMine-Vent is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General
+ *  Public License along with xmlMine-Vent.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "sparse.h"
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <vector>
+#include <cmath>
+using namespace std;
+
+
+XMVentSparseMatrix::XMVentSparseMatrix()
+{
+    clear();
+}
+
+
+void XMVentSparseMatrix::clear()
+{
+    n = 0;
+    rowOffset.fill( 0, 1 );
+    column.clear();
+    value.clear();
+}
+
+
+/// set the pattern from per-row column lists (duplicates allowed) and zero all values
+void XMVentSparseMatrix::setPattern( int size, const QVector<QVector<int> >& rowColumns )
+{
+    n = size;
+    rowOffset.resize( n + 1 );
+    column.clear();
+
+    rowOffset[ 0 ] = 0;
+    for( int i = 0; i < n; i++ ) {
+        QVector<int> row( rowColumns[i] );
+        sort( row.begin(), row.end() );
+        row.erase( unique( row.begin(), row.end() ), row.end() );
+        column += row;
+        rowOffset[ i + 1 ] = column.count();
+    }
+
+    value.fill( 0., column.count() );
+}
+
+
+/// return the value index of entry (row, col) or -1 if it is not in the pattern
+int XMVentSparseMatrix::find( int row, int col ) const
+{
+    const int* begin = column.constData() + rowOffset[ row ];
+    const int* end = column.constData() + rowOffset[ row + 1 ];
+    const int* it = lower_bound( begin, end, col );
+    if( it != end && *it == col ) {
+        return it - column.constData();
+    }
+    return -1;
+}
+
+
+/// y = A x
+void XMVentSparseMatrix::multiply( const double* x, double* y ) const
+{
+    const int* offset = rowOffset.constData();
+    const int* col = column.constData();
+    const double* val = value.constData();
+
+    for( int i = 0; i < n; i++ ) {
+        double sum = 0.;
+        for( int p = offset[i]; p < offset[i+1]; p++ ) {
+            sum += val[ p ] * x[ col[p] ];
+        }
+        y[ i ] = sum;
+    }
+}
+
+
+/// greedy minimum degree ordering on the explicit elimination graph.
+/// Each eliminated node turns its remaining neighbours into a clique.
+static void minimumDegreeOrder( const XMVentSparseMatrix& a, QVector<int>& perm )
+{
+    const int n = a.n;
+    QVector<QVector<int> > adj( n );
+    for( int i = 0; i < n; i++ ) {
+        for( int p = a.rowOffset[i]; p < a.rowOffset[i+1]; p++ ) {
+            if( a.column[p] != i ) {
+                adj[ i ].append( a.column[p] );
+            }
+        }
+    }
+
+    typedef pair<int,int> DegreeNode;
+    priority_queue<DegreeNode, vector<DegreeNode>, greater<DegreeNode> > heap;
+    for( int i = 0; i < n; i++ ) {
+        heap.push( DegreeNode( adj[i].count(), i ) );
+    }
+
+    QVector<bool> eliminated( n, false );
+    QVector<int> merged;
+    perm.clear();
+    perm.reserve( n );
+    while( !heap.empty() ) {
+        DegreeNode top = heap.top();
+        heap.pop();
+        const int v = top.second;
+        if( eliminated[v] || top.first != adj[v].count() ) {
+            continue;   // stale heap entry
+        }
+        eliminated[ v ] = true;
+        perm.append( v );
+
+        const QVector<int>& nb = adj[ v ];
+        for( int k = 0; k < nb.count(); k++ ) {
+            const int u = nb[ k ];
+            const QVector<int>& au = adj[ u ];
+
+            // merged = (adj[u] + adj[v]) - {u, v}, both inputs are sorted
+            merged.clear();
+            int i = 0, j = 0;
+            while( i < au.count() || j < nb.count() ) {
+                int c;
+                if( j >= nb.count() || ( i < au.count() && au[i] < nb[j] ) ) {
+                    c = au[ i++ ];
+                } else if( i >= au.count() || nb[j] < au[i] ) {
+                    c = nb[ j++ ];
+                } else {
+                    c = au[ i++ ];
+                    j++;
+                }
+                if( c != u && c != v ) {
+                    merged.append( c );
+                }
+            }
+            adj[ u ] = merged;
+            heap.push( DegreeNode( merged.count(), u ) );
+        }
+        adj[ v ].clear();
+    }
+}
+
+
+XMVentSparseLDL::XMVentSparseLDL()
+{
+    clear();
+}
+
+
+void XMVentSparseLDL::clear()
+{
+    m_n = 0;
+    m_perm.clear();
+    m_permInv.clear();
+    m_parent.clear();
+    m_lp.clear();
+    m_li.clear();
+    m_lx.clear();
+    m_d.clear();
+}
+
+
+/// choose a fill reducing ordering and compute the elimination tree and column counts of L
+bool XMVentSparseLDL::analyze( const XMVentSparseMatrix& a )
+{
+    clear();
+    m_n = a.n;
+
+    minimumDegreeOrder( a, m_perm );
+    m_permInv.resize( m_n );
+    for( int k = 0; k < m_n; k++ ) {
+        m_permInv[ m_perm[k] ] = k;
+    }
+
+    m_parent.fill( -1, m_n );
+    m_lnz.fill( 0, m_n );
+    m_flag.fill( -1, m_n );
+    for( int k = 0; k < m_n; k++ ) {
+        m_flag[ k ] = k;
+        const int kk = m_perm[ k ];
+        for( int p = a.rowOffset[kk]; p < a.rowOffset[kk+1]; p++ ) {
+            int i = m_permInv[ a.column[p] ];
+            if( i < k ) {
+                // follow path from i to root of etree, stop at flagged node
+                for( ; m_flag[i] != k; i = m_parent[i] ) {
+                    if( m_parent[i] == -1 ) {
+                        m_parent[ i ] = k;
+                    }
+                    m_lnz[ i ]++;
+                    m_flag[ i ] = k;
+                }
+            }
+        }
+    }
+
+    m_lp.resize( m_n + 1 );
+    m_lp[ 0 ] = 0;
+    for( int k = 0; k < m_n; k++ ) {
+        m_lp[ k + 1 ] = m_lp[ k ] + m_lnz[ k ];
+    }
+    m_li.resize( m_lp[m_n] );
+    m_lx.resize( m_lp[m_n] );
+    m_d.resize( m_n );
+    m_y.fill( 0., m_n );
+    m_pattern.resize( m_n );
+    m_x.resize( m_n );
+
+    return true;
+}
+
+
+/// numeric up-looking LDL' factorization of a matrix with the analyzed pattern.
+/// Non-positive pivots are replaced by a small positive value so that a
+/// singular Jacobian still gives a usable (damped) step.
+bool XMVentSparseLDL::factorize( const XMVentSparseMatrix& a )
+{
+    if( !isAnalyzed() || a.n != m_n ) {
+        return false;
+    }
+
+    double diagMax = 0.;
+    for( int i = 0; i < m_n; i++ ) {
+        int p = a.find( i, i );
+        if( p >= 0 ) {
+            diagMax = max( diagMax, fabs( a.value[p] ) );
+        }
+    }
+    const double pivotMin = ( diagMax > 0. ? diagMax : 1. ) * 1e-12;
+
+    bool regular = true;
+    m_flag.fill( -1 );
+    for( int k = 0; k < m_n; k++ ) {
+        // nonzero pattern of row k of L, in topological order
+        m_y[ k ] = 0.;
+        int top = m_n;
+        m_flag[ k ] = k;
+        m_lnz[ k ] = 0;
+        const int kk = m_perm[ k ];
+        for( int p = a.rowOffset[kk]; p < a.rowOffset[kk+1]; p++ ) {
+            int i = m_permInv[ a.column[p] ];
+            if( i <= k ) {
+                m_y[ i ] += a.value[ p ];
+                int len;
+                for( len = 0; m_flag[i] != k; i = m_parent[i] ) {
+                    m_pattern[ len++ ] = i;
+                    m_flag[ i ] = k;
+                }
+                while( len > 0 ) {
+                    m_pattern[ --top ] = m_pattern[ --len ];
+                }
+            }
+        }
+
+        // compute numerical values of row k of L
+        double d = m_y[ k ];
+        m_y[ k ] = 0.;
+        for( ; top < m_n; top++ ) {
+            const int i = m_pattern[ top ];
+            const double yi = m_y[ i ];
+            m_y[ i ] = 0.;
+            const int p2 = m_lp[ i ] + m_lnz[ i ];
+            int p;
+            for( p = m_lp[i]; p < p2; p++ ) {
+                m_y[ m_li[p] ] -= m_lx[ p ] * yi;
+            }
+            const double lki = yi / m_d[ i ];
+            d -= lki * yi;
+            m_li[ p ] = k;
+            m_lx[ p ] = lki;
+            m_lnz[ i ]++;
+        }
+
+        if( !( d > pivotMin ) ) {
+            d = pivotMin;
+            regular = false;
+        }
+        m_d[ k ] = d;
+    }
+
+    return regular;
+}
+
+
+/// solve A x = b in place
+void XMVentSparseLDL::solve( double* b ) const
+{
+    double* x = m_x.data();
+    const int* lp = m_lp.constData();
+    const int* li = m_li.constData();
+    const double* lx = m_lx.constData();
+
+    for( int k = 0; k < m_n; k++ ) {
+        x[ k ] = b[ m_perm[k] ];
+    }
+    for( int j = 0; j < m_n; j++ ) {
+        for( int p = lp[j]; p < lp[j+1]; p++ ) {
+            x[ li[p] ] -= lx[ p ] * x[ j ];
+        }
+    }
+    for( int j = 0; j < m_n; j++ ) {
+        x[ j ] /= m_d[ j ];
+    }
+    for( int j = m_n - 1; j >= 0; j-- ) {
+        for( int p = lp[j]; p < lp[j+1]; p++ ) {
+            x[ j ] -= lx[ p ] * x[ li[p] ];
+        }
+    }
+    for( int k = 0; k < m_n; k++ ) {
+        b[ m_perm[k] ] = x[ k ];
+    }
+}
+
+
+XMVentSparsePCG::XMVentSparsePCG()
+{
+    m_preconditioner = IncompleteCholesky;
+    clear();
+}
+
+
+void XMVentSparsePCG::setPreconditioner( Preconditioner preconditioner )
+{
+    m_preconditioner = preconditioner;
+}
+
+
+XMVentSparsePCG::Preconditioner XMVentSparsePCG::preconditioner() const
+{
+    return m_preconditioner;
+}
+
+
+void XMVentSparsePCG::clear()
+{
+    m_diagInv.clear();
+    m_lOffset.clear();
+    m_lColumn.clear();
+    m_lValue.clear();
+    m_useCholesky = false;
+}
+
+
+/// compute the Jacobi scaling and, if selected, a zero fill incomplete Cholesky factor
+void XMVentSparsePCG::setup( const XMVentSparseMatrix& a )
+{
+    const int n = a.n;
+    m_diagInv.resize( n );
+    for( int i = 0; i < n; i++ ) {
+        int p = a.find( i, i );
+        double d = ( p >= 0 ? a.value[p] : 0. );
+        m_diagInv[ i ] = ( d > 0. ? 1. / d : 1. );
+    }
+
+    m_r.resize( n );
+    m_z.resize( n );
+    m_p.resize( n );
+    m_q.resize( n );
+
+    m_useCholesky = false;
+    if( m_preconditioner != IncompleteCholesky ) {
+        return;
+    }
+
+    // lower triangle pattern, the diagonal is the last entry of each row
+    if( m_lOffset.count() != n + 1 ) {
+        m_lOffset.resize( n + 1 );
+        m_lColumn.clear();
+        m_lOffset[ 0 ] = 0;
+        for( int i = 0; i < n; i++ ) {
+            for( int p = a.rowOffset[i]; p < a.rowOffset[i+1] && a.column[p] <= i; p++ ) {
+                m_lColumn.append( a.column[p] );
+            }
+            m_lOffset[ i + 1 ] = m_lColumn.count();
+        }
+    }
+    m_lValue.resize( m_lColumn.count() );
+
+    const int* lOffset = m_lOffset.constData();
+    const int* lColumn = m_lColumn.constData();
+    double* lValue = m_lValue.data();
+    for( int i = 0; i < n; i++ ) {
+        for( int p = lOffset[i]; p < lOffset[i+1]; p++ ) {
+            const int k = lColumn[ p ];
+            double sum = a.value[ a.find( i, k ) ];
+
+            // subtract the sparse dot product of rows i and k over columns < k
+            int pi = lOffset[ i ], pk = lOffset[ k ];
+            while( pi < p && pk < lOffset[k+1] - 1 ) {
+                if( lColumn[pi] < lColumn[pk] ) {
+                    pi++;
+                } else if( lColumn[pk] < lColumn[pi] ) {
+                    pk++;
+                } else {
+                    sum -= lValue[ pi++ ] * lValue[ pk++ ];
+                }
+            }
+
+            if( k < i ) {
+                lValue[ p ] = sum / lValue[ lOffset[k+1] - 1 ];
+            } else if( sum > 0. ) {
+                lValue[ p ] = sqrt( sum );
+            } else {
+                return;     // breakdown, keep the Jacobi preconditioner
+            }
+        }
+    }
+    m_useCholesky = true;
+}
+
+
+/// z = M^-1 r
+void XMVentSparsePCG::apply( const double* r, double* z ) const
+{
+    const int n = m_diagInv.count();
+
+    if( !m_useCholesky ) {
+        for( int i = 0; i < n; i++ ) {
+            z[ i ] = r[ i ] * m_diagInv[ i ];
+        }
+        return;
+    }
+
+    // forward solve L y = r
+    const int* lOffset = m_lOffset.constData();
+    const int* lColumn = m_lColumn.constData();
+    const double* lValue = m_lValue.constData();
+    for( int i = 0; i < n; i++ ) {
+        double sum = r[ i ];
+        const int diag = lOffset[ i + 1 ] - 1;
+        for( int p = lOffset[i]; p < diag; p++ ) {
+            sum -= lValue[ p ] * z[ lColumn[p] ];
+        }
+        z[ i ] = sum / lValue[ diag ];
+    }
+
+    // backward solve L' z = y, column oriented over the rows of L
+    for( int i = n - 1; i >= 0; i-- ) {
+        const int diag = lOffset[ i + 1 ] - 1;
+        z[ i ] /= lValue[ diag ];
+        for( int p = lOffset[i]; p < diag; p++ ) {
+            z[ lColumn[p] ] -= lValue[ p ] * z[ i ];
+        }
+    }
+}
+
+
+/// solve A x = b starting from the given x; returns the number of iterations
+int XMVentSparsePCG::solve( const XMVentSparseMatrix& a, const double* b, double* x,
+                            double relativeTolerance, int iterationMax )
+{
+    const int n = a.n;
+    double* r = m_r.data();
+    double* z = m_z.data();
+    double* p = m_p.data();
+    double* q = m_q.data();
+
+    double bNorm = 0.;
+    for( int i = 0; i < n; i++ ) {
+        bNorm += b[ i ] * b[ i ];
+    }
+    if( bNorm == 0. ) {
+        for( int i = 0; i < n; i++ ) {
+            x[ i ] = 0.;
+        }
+        return 0;
+    }
+    const double tolerance = relativeTolerance * relativeTolerance * bNorm;
+
+    a.multiply( x, r );
+    double rNorm = 0.;
+    for( int i = 0; i < n; i++ ) {
+        r[ i ] = b[ i ] - r[ i ];
+        rNorm += r[ i ] * r[ i ];
+    }
+
+    apply( r, z );
+    double rz = 0.;
+    for( int i = 0; i < n; i++ ) {
+        p[ i ] = z[ i ];
+        rz += r[ i ] * z[ i ];
+    }
+
+    int it;
+    for( it = 0; it < iterationMax && rNorm > tolerance; it++ ) {
+        a.multiply( p, q );
+        double pq = 0.;
+        for( int i = 0; i < n; i++ ) {
+            pq += p[ i ] * q[ i ];
+        }
+        if( pq <= 0. ) {
+            break;      // not positive definite in this direction
+        }
+
+        const double alpha = rz / pq;
+        rNorm = 0.;
+        for( int i = 0; i < n; i++ ) {
+            x[ i ] += alpha * p[ i ];
+            r[ i ] -= alpha * q[ i ];
+            rNorm += r[ i ] * r[ i ];
+        }
+
+        apply( r, z );
+        double rzNew = 0.;
+        for( int i = 0; i < n; i++ ) {
+            rzNew += r[ i ] * z[ i ];
+        }
+        const double beta = rzNew / rz;
+        rz = rzNew;
+        for( int i = 0; i < n; i++ ) {
+            p[ i ] = z[ i ] + beta * p[ i ];
+        }
+    }
+
+    return it;
+}
@@ -0,0 +1,115 @@
+/*
+ *  Copyright (C) 2010 Andrew Wilson.
+ *  All rights reserved.
+ *  Contact email: amwgeo@gmail.com
+ *
+ *  This file is part of xmlMine-Vent
+ *
+ *  xmlMine-Vent is free software: you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation, either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  xmlMine-Vent is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General
+ *  Public License along with xmlMine-Vent.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef XMVENTSPARSE_H
+#define XMVENTSPARSE_H
+
+#include "xmvent-global.h"
+
+#include <QVector>
+
+
+/// Symmetric sparse matrix in compressed sparse row form.
+/// Both triangles are stored and the columns of each row are sorted.
+struct XMVENTSHARED_EXPORT XMVentSparseMatrix {
+    int n;
+    QVector<int> rowOffset;     // n+1 offsets into column / value
+    QVector<int> column;
+    QVector<double> value;
+
+    XMVentSparseMatrix();
+
+    void clear();
+    void setPattern( int size, const QVector<QVector<int> >& rowColumns );
+    int find( int row, int col ) const;
+    void multiply( const double* x, double* y ) const;
+};
+
+
+/// Sparse LDL' factorization for symmetric positive definite systems.
+/// analyze() picks a minimum degree ordering and the symbolic structure once
+/// per pattern; factorize() can then be repeated for new values.
+class XMVENTSHARED_EXPORT XMVentSparseLDL
+{
+protected:
+    int m_n;
+    QVector<int> m_perm;        // new index -> matrix index
+    QVector<int> m_permInv;     // matrix index -> new index
+    QVector<int> m_parent;      // elimination tree
+    QVector<int> m_lp;          // column offsets of L
+    QVector<int> m_li;
+    QVector<double> m_lx;
+    QVector<double> m_d;
+
+    // numeric workspace
+    QVector<int> m_lnz, m_flag, m_pattern;
+    QVector<double> m_y;
+    mutable QVector<double> m_x;
+
+public:
+    XMVentSparseLDL();
+
+    bool analyze( const XMVentSparseMatrix& a );
+    bool factorize( const XMVentSparseMatrix& a );
+    void solve( double* b ) const;
+    void clear();
+
+    bool isAnalyzed() const { return m_lp.count() > 0; }
+    int factorNonZeros() const { return m_li.count(); }
+};
+
+
+/// Preconditioned conjugate gradient for symmetric positive definite systems.
+/// setup() computes the preconditioner for the current matrix values.
+class XMVENTSHARED_EXPORT XMVentSparsePCG
+{
+public:
+    enum Preconditioner { Jacobi, IncompleteCholesky };
+
+protected:
+    Preconditioner m_preconditioner;
+    QVector<double> m_diagInv;      // Jacobi, also the fallback if IC(0) breaks down
+    QVector<int> m_lOffset;         // IC(0) factor: lower triangle of A's pattern, by rows
+    QVector<int> m_lColumn;
+    QVector<double> m_lValue;
+    bool m_useCholesky;
+
+    // iteration workspace
+    QVector<double> m_r, m_z, m_p, m_q;
+
+    void apply( const double* r, double* z ) const;
+
+public:
+    XMVentSparsePCG();
+
+    void setPreconditioner( Preconditioner preconditioner );
+    Preconditioner preconditioner() const;
+
+    void setup( const XMVentSparseMatrix& a );
+    int solve( const XMVentSparseMatrix& a, const double* b, double* x,
+               double relativeTolerance, int iterationMax );
+    void clear();
+};
+
+
+#endif // XMVENTSPARSE_H
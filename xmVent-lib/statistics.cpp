@@ -0,0 +1,152 @@
+/*
+ *  Copyright (C) 2010 Andrew Wilson.
+ *  All rights reserved.
+ *  Contact email: amwgeo@gmail.com
+ *
+ *  This file is part of xmlMine-Vent
+ *
+ *  xmlMine-Vent is free software: you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation, either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  xmlMine-Vent is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General
+ *  Public License along with xmlMine-Vent.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "statistics.h"
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QVariantList>
+
+#include <algorithm>
+
+
+XMVentSolveHCStatistics::XMVentSolveHCStatistics()
+{
+    historyLength = 1000;
+    graphTime = meshTime = flowInitializeTime = 0.;
+    clearSolve();
+}
+
+
+/// forget the last solve but keep the setup times and settings
+void XMVentSolveHCStatistics::clearSolve()
+{
+    method.clear();
+    iterations = 0;
+    converged = false;
+    tolerance = 0.;
+    residual = 0.;
+    imbalance = 0.;
+    historyStride = 1;
+    history.clear();
+    worstMesh.clear();
+    worstImbalance.clear();
+    iterationTime = 0.;
+}
+
+
+/// residual after (0 based) iteration, kept if it falls on the sampling interval
+void XMVentSolveHCStatistics::record( int iteration, double residual )
+{
+    this->residual = residual;
+    if( historyLength <= 0 || iteration % historyStride != 0 ) {
+        return;
+    }
+    if( history.count() >= historyLength ) {
+        // full: keep iterations 0, 2s, 4s, ... and sample half as often
+        int k = 0;
+        for( int j = 0; j < history.count(); j += 2 ) {
+            history[ k++ ] = history[ j ];
+        }
+        history.resize( k );
+        historyStride *= 2;
+        if( iteration % historyStride != 0 ) {
+            return;
+        }
+    }
+    history.append( residual );
+}
+
+
+/// orders mesh indices by decreasing imbalance
+struct XMVentImbalanceGreater {
+    const QVector<double>& imbalance;
+
+    explicit XMVentImbalanceGreater( const QVector<double>& i ) : imbalance( i ) {}
+    bool operator()( int a, int b ) const {
+        return imbalance[a] != imbalance[b] ? imbalance[a] > imbalance[b] : a < b;
+    }
+};
+
+
+/// keep the count meshes of largest imbalance
+void XMVentSolveHCStatistics::rankMeshes( const QVector<double>& meshImbalance, int count )
+{
+    QVector<int> order( meshImbalance.count() );
+    for( int i = 0; i < order.count(); i++ ) {
+        order[ i ] = i;
+    }
+    count = qMin( count, order.count() );
+    std::partial_sort( order.begin(), order.begin() + count, order.end(),
+                       XMVentImbalanceGreater( meshImbalance ) );
+
+    worstMesh.resize( count );
+    worstImbalance.resize( count );
+    for( int k = 0; k < count; k++ ) {
+        worstMesh[ k ] = order[ k ];
+        worstImbalance[ k ] = meshImbalance[ order[k] ];
+    }
+}
+
+
+QVariantMap XMVentSolveHCStatistics::toVariantMap() const
+{
+    QVariantMap r;
+    r.insert( "method", method );
+    r.insert( "iterations", iterations );
+    r.insert( "converged", converged );
+    r.insert( "tolerance", tolerance );
+    r.insert( "residual", residual );
+    r.insert( "imbalance", imbalance );
+
+    QVariantList historyList;
+    for( int k = 0; k < history.count(); k++ ) {
+        historyList.append( history[k] );
+    }
+    r.insert( "residualHistory", historyList );
+    r.insert( "historyStride", historyStride );
+
+    QVariantList worst;
+    for( int k = 0; k < worstMesh.count(); k++ ) {
+        QVariantMap mesh;
+        mesh.insert( "mesh", worstMesh[k] );
+        mesh.insert( "imbalance", worstImbalance[k] );
+        worst.append( mesh );
+    }
+    r.insert( "worstMeshes", worst );
+
+    QVariantMap time;
+    time.insert( "graph", graphTime );
+    time.insert( "createMesh", meshTime );
+    time.insert( "flowInitialize", flowInitializeTime );
+    time.insert( "iteration", iterationTime );
+    r.insert( "time", time );
+
+    return r;
+}
+
+
+QByteArray XMVentSolveHCStatistics::toJson() const
+{
+    return QJsonDocument( QJsonObject::fromVariantMap( toVariantMap() ) ).toJson();
+}
@@ -0,0 +1,74 @@
+/*
+ *  Copyright (C) 2010 Andrew Wilson.
+ *  All rights reserved.
+ *  Contact email: amwgeo@gmail.com
+ *
+ *  This file is part of xmlMine-Vent
+ *
+ *  xmlMine-Vent is free software: you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation, either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  xmlMine-Vent is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General
+ *  Public License along with xmlMine-Vent.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef XMVENTSTATISTICS_H
+#define XMVENTSTATISTICS_H
+
+#include "xmvent-global.h"
+
+#include <QByteArray>
+#include <QString>
+#include <QVariantMap>
+#include <QVector>
+
+
+/// What the last XMVentSolveHC::solve() did: iterations, the convergence
+/// measure after each iteration, the balanced meshes furthest from balance
+/// and where the wall time went.  The Hardy-Cross measure sums each mesh
+/// imbalance before its own correction, so with over-relaxation the
+/// imbalance of the returned flows may differ from the last residual.  The
+/// history keeps at most historyLength values; when it fills up every other
+/// value is dropped and the sampling interval doubles, so a long solve keeps
+/// an evenly spaced outline of its convergence.  An incremental solve starts
+/// its history at the sweeps it already spent.
+struct XMVENTSHARED_EXPORT XMVentSolveHCStatistics {
+    QString method;
+    int iterations;
+    bool converged;
+    double tolerance;
+    double residual;                // convergence measure of the last iteration, compared with tolerance
+    double imbalance;               // summed absolute mesh imbalance of the returned flows
+    int historyLength;              // most values kept, 0 for no history
+    int historyStride;              // the residual of every historyStride-th iteration is kept
+    QVector<double> history;
+    QVector<int> worstMesh;         // balanced meshes of largest final imbalance, worst first
+    QVector<double> worstImbalance;
+
+    // wall time in ms; the setup times are those of the last initialize()
+    double graphTime;               // network graph, surface junctions merged into one node
+    double meshTime;                // spanning tree and meshes, or loading them from the cache
+    double flowInitializeTime;
+    double iterationTime;           // parameter gather and the iterations
+
+    XMVentSolveHCStatistics();
+
+    void clearSolve();
+    void record( int iteration, double residual );
+    void rankMeshes( const QVector<double>& meshImbalance, int count );
+
+    QVariantMap toVariantMap() const;
+    QByteArray toJson() const;
+};
+
+
+#endif // XMVENTSTATISTICS_H
@@ -0,0 +1,70 @@
+/*
+ *  Copyright (C) 2010 Andrew Wilson.
+ *  All rights reserved.
+ *  Contact email: amwgeo@gmail.com
+ *
+ *  This file is part of xmlMine-Vent
+ *
+ *  xmlMine-Vent is free software: you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation, either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  xmlMine-Vent is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General
+ *  Public License along with xmlMine-Vent.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "stringarena.h"
+
+
+/// add a string, returning its index
+int XMVentStringArena::append( const QStringRef& s )
+{
+    begin.append( text.size() );
+    length.append( s.size() );
+    text.append( s );
+    return begin.count() - 1;
+}
+
+
+void XMVentStringArena::set( int i, const QString& s )
+{
+    begin[ i ] = text.size();
+    length[ i ] = s.size();
+    text.append( s );
+}
+
+
+/// index of the first string equal to s, -1 if there is none
+int XMVentStringArena::indexOf( const QString& s ) const
+{
+    for( int i = 0; i < begin.count(); i++ ) {
+        if( length[i] == s.size() && ref( i ) == s ) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+void XMVentStringArena::reserve( int n )
+{
+    begin.reserve( n );
+    length.reserve( n );
+}
+
+
+void XMVentStringArena::clear()
+{
+    text.clear();
+    begin.clear();
+    length.clear();
+}
@@ -0,0 +1,56 @@
+/*
+ *  Copyright (C) 2010 Andrew Wilson.
+ *  All rights reserved.
+ *  Contact email: amwgeo@gmail.com
+ *
+ *  This file is part of xmlMine-Vent
+ *
+ *  xmlMine-Vent is free software: you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation, either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  xmlMine-Vent is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General
+ *  Public License along with xmlMine-Vent.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef XMVENTSTRINGARENA_H
+#define XMVENTSTRINGARENA_H
+
+#include "xmvent-global.h"
+
+#include <QString>
+#include <QStringRef>
+#include <QVector>
+
+
+/// Column of strings held in one buffer: string i is the text
+/// [ begin[i], begin[i] + length[i] ).  Appending does not allocate per
+/// string and clear() frees the whole column at once.  A changed string is
+/// appended again; its old text stays in the buffer until clear().
+struct XMVENTSHARED_EXPORT XMVentStringArena {
+    QString text;
+    QVector<int> begin;
+    QVector<int> length;
+
+    int count() const { return begin.count(); }
+    bool isEmpty() const { return begin.isEmpty(); }
+    QString operator[]( int i ) const { return text.mid( begin[i], length[i] ); }
+    QStringRef ref( int i ) const { return QStringRef( &text, begin[i], length[i] ); }
+
+    int append( const QStringRef& s );
+    void set( int i, const QString& s );
+    int indexOf( const QString& s ) const;
+    void reserve( int n );
+    void clear();
+};
+
+#endif // XMVENTSTRINGARENA_H
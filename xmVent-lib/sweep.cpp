@@ -0,0 +1,302 @@
+/*
+ *  Copyright (C) 2010 Andrew Wilson.
+ *  All rights reserved.
+ *  Contact email: amwgeo@gmail.com
+ *
+ *  This file is part of xmlMine-Vent
+ *
+ *  xmlMine-Vent is free software: you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation, either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  xmlMine-Vent is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General
+ *  Public License along with xmlMine-Vent.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "sweep.h"
+
+#include "network.h"
+#include "branch.h"
+#include "fan.h"
+
+#include <QDebug>
+#include <QAtomicInt>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+
+
+/// set one parameter of net to its value in the scenario
+static void xmVentSweepApply( XMVentNetwork& net, const XMVentSweepParameter& parameter, float value )
+{
+    switch( parameter.kind ) {
+    case XMVentSweepParameter::FanPressure:
+        net.m_fanDefinition[ parameter.index ]->setFixedPressure( value );
+        break;
+    case XMVentSweepParameter::Resistance:
+        net.m_branch.resistance[ parameter.index ] = value;
+        break;
+    case XMVentSweepParameter::FixedFlow:
+        net.m_fixedFlow[ parameter.index ] = value;
+        break;
+    }
+}
+
+
+/// value of the parameter in the unmodified network
+static float xmVentSweepBase( const XMVentNetwork& net, const XMVentSweepParameter& parameter )
+{
+    switch( parameter.kind ) {
+    case XMVentSweepParameter::FanPressure:
+        return net.m_fanDefinition[ parameter.index ]->fixedPressure();
+    case XMVentSweepParameter::Resistance:
+        return net.m_branch.resistance[ parameter.index ];
+    case XMVentSweepParameter::FixedFlow:
+        break;
+    }
+    return net.m_fixedFlow.value( parameter.index );
+}
+
+
+/// set one parameter of a scenario on the shared model
+static void xmVentSweepApply( XMVentSolveHCScenario& state, const XMVentSweepParameter& parameter )
+{
+    switch( parameter.kind ) {
+    case XMVentSweepParameter::FanPressure:
+        state.setFanPressure( parameter.index, parameter.value );
+        break;
+    case XMVentSweepParameter::Resistance:
+        state.setResistance( parameter.index, parameter.value );
+        break;
+    case XMVentSweepParameter::FixedFlow:
+        state.setFixedFlow( parameter.index, parameter.value );
+        break;
+    }
+}
+
+
+/// result map of one scenario
+static void xmVentSweepResult( QVariantMap& result, const QVector<float>& flowList,
+                               const QVariantList& fixedFlowPressure, int iterations, bool fail )
+{
+    QVariantList flow;
+    flow.reserve( flowList.count() );
+    for( int b = 0; b < flowList.count(); b++ ) {
+        flow.append( flowList[b] );
+    }
+    result.insert( "flow", flow );
+    result.insert( "fixedFlowPressure", fixedFlowPressure );
+    result.insert( "iterations", iterations );
+    result.insert( "converged", !fail );
+}
+
+
+/// one thread of a sweep: takes the next unsolved scenario until none are left.
+/// Plain Hardy-Cross scenarios share the compiled model, other settings need
+/// a copy of the network per thread.
+class XMVentSweepTask : public QRunnable
+{
+protected:
+    const XMVentNetwork& m_prototype;
+    QSharedPointer<const XMVentSolveHCModel> m_model;
+    const QList<XMVentSweepScenario>& m_scenario;
+    QVariantMap* m_result;
+    QAtomicInt& m_next;
+    float m_tolerance;
+    int m_iterationMax;
+    float m_lambda;
+
+    void runModel()
+    {
+        XMVentSolveHCScenario state( m_model );
+        state.setPrecision( m_prototype.m_solver.precision() );
+        for( ;; ) {
+            const int i = m_next.fetchAndAddOrdered( 1 );
+            if( i >= m_scenario.count() ) {
+                break;
+            }
+            state.reset();
+            const XMVentSweepScenario& scenario = m_scenario[ i ];
+            for( int k = 0; k < scenario.count(); k++ ) {
+                xmVentSweepApply( state, scenario[k] );
+            }
+            bool fail = state.solve( m_tolerance, m_iterationMax, m_lambda );
+            xmVentSweepResult( m_result[i], state.flow(), state.fixedFlowPressure(), state.iterations(), fail );
+        }
+    }
+
+    void runNetwork()
+    {
+        // per thread network and solver; the meshes are found once, from the
+        // unmodified network so that every thread solves on the same meshes
+        XMVentNetwork net;
+        net.copyFrom( m_prototype );
+        net.m_solver.setThreadCount( 1 );
+        net.m_solver.setIncremental( false );
+        net.m_solver.initialize();
+
+        const XMVentSweepScenario* previous = 0;
+        for( ;; ) {
+            const int i = m_next.fetchAndAddOrdered( 1 );
+            if( i >= m_scenario.count() ) {
+                break;
+            }
+
+            // undo the last scenario, then set this one
+            if( previous ) {
+                for( int k = 0; k < previous->count(); k++ ) {
+                    xmVentSweepApply( net, previous->at( k ), xmVentSweepBase( m_prototype, previous->at( k ) ) );
+                }
+            }
+            const XMVentSweepScenario& scenario = m_scenario[ i ];
+            for( int k = 0; k < scenario.count(); k++ ) {
+                xmVentSweepApply( net, scenario[k], scenario[k].value );
+            }
+            previous = &scenario;
+
+            net.m_solver.resetFlow();
+            bool fail = net.m_solver.solve( m_tolerance, m_iterationMax, m_lambda );
+            xmVentSweepResult( m_result[i], net.m_solver.m_flowList, net.m_solver.fixedFlowPressure(),
+                               net.m_solver.iterations(), fail );
+        }
+    }
+
+public:
+    XMVentSweepTask( const XMVentNetwork& prototype, QSharedPointer<const XMVentSolveHCModel> model,
+                     const QList<XMVentSweepScenario>& scenario, QVariantMap* result, QAtomicInt& next,
+                     float tolerance, int iterationMax, float lambda ) :
+        m_prototype( prototype ), m_model( model ), m_scenario( scenario ), m_result( result ), m_next( next ),
+        m_tolerance( tolerance ), m_iterationMax( iterationMax ), m_lambda( lambda ) {}
+
+    void run()
+    {
+        if( m_model.isNull() ) {
+            runNetwork();
+        } else {
+            runModel();
+        }
+    }
+};
+
+
+/// translate a script assignment { "fan:main_fan": 1200, "resistance:branch5": 20 }
+bool XMVentSweep::parse( const XMVentNetwork* net, const QVariantMap& assignment, XMVentSweepScenario& scenario )
+{
+    scenario.clear();
+    QVariantMap::const_iterator it;
+    for( it = assignment.begin(); it != assignment.end(); it++ ) {
+        const int colon = it.key().indexOf( ':' );
+        const QString kind = it.key().left( colon );
+        const QString id = it.key().mid( colon + 1 );
+
+        XMVentSweepParameter parameter;
+        parameter.index = -1;
+        if( colon < 0 ) {
+            // no kind given
+        } else if( kind == "fan" ) {
+            parameter.kind = XMVentSweepParameter::FanPressure;
+            for( int f = 0; f < net->m_fanDefinition.count(); f++ ) {
+                if( net->m_fanDefinition[f]->id() == id ) {
+                    parameter.index = f;
+                }
+            }
+        } else if( kind == "resistance" ) {
+            parameter.kind = XMVentSweepParameter::Resistance;
+            parameter.index = net->findBranchIndex( id );
+        } else if( kind == "flow" ) {
+            parameter.kind = XMVentSweepParameter::FixedFlow;
+            parameter.index = net->findBranchIndex( id );
+            if( !net->m_fixedFlow.contains( parameter.index ) ) {
+                parameter.index = -1;
+            }
+        }
+
+        bool ok;
+        parameter.value = it.value().toFloat( &ok );
+        if( parameter.index < 0 || !ok ) {
+            qDebug() << "Sweep parameter not understood:" << it.key() << it.value();
+            return false;
+        }
+        scenario.append( parameter );
+    }
+
+    return true;
+}
+
+
+/// every combination of the listed values, the last key varying fastest
+QList<QVariantMap> XMVentSweep::grid( const QVariantMap& values )
+{
+    QList<QVariantMap> assignments;
+    assignments.append( QVariantMap() );
+
+    QVariantMap::const_iterator it;
+    for( it = values.begin(); it != values.end(); it++ ) {
+        const QVariantList value = it.value().toList();
+        QList<QVariantMap> combined;
+        for( int a = 0; a < assignments.count(); a++ ) {
+            for( int v = 0; v < value.count(); v++ ) {
+                QVariantMap assignment( assignments[a] );
+                assignment.insert( it.key(), value[v] );
+                combined.append( assignment );
+            }
+        }
+        assignments = combined;
+    }
+
+    return assignments;
+}
+
+
+/// solve net for each assignment; the results are in assignment order, each
+/// holding the assignment, flow (branch order), fixedFlowPressure, iterations
+/// and converged.  Empty if an assignment is not understood.
+QVariantList XMVentSweep::run( XMVentNetwork* net, const QList<QVariantMap>& assignments,
+                               float meshCorrectionTolerance, int iterationMax, float lambda, int threadCount )
+{
+    QList<XMVentSweepScenario> scenario;
+    for( int i = 0; i < assignments.count(); i++ ) {
+        XMVentSweepScenario s;
+        if( !parse( net, assignments[i], s ) ) {
+            return QVariantList();
+        }
+        scenario.append( s );
+    }
+
+    // plain Hardy-Cross needs no copy of the network
+    const XMVentSolveHC& solver = net->m_solver;
+    QSharedPointer<const XMVentSolveHCModel> model;
+    if( solver.method() == XMVentSolveHC::HardyCross && solver.acceleration() == XMVentSolveHC::NoAcceleration
+        && !solver.adaptiveLambda() && !solver.meshColoring() && !solver.reduction() ) {
+        model = net->m_solver.model();
+    }
+
+    const int nThreads = qMin( threadCount > 0 ? threadCount : QThread::idealThreadCount(), scenario.count() );
+    QVector<QVariantMap> result( scenario.count() );
+    QAtomicInt next( 0 );
+    QThreadPool pool;
+    pool.setMaxThreadCount( qMax( nThreads, 1 ) );
+    for( int t = 0; t < nThreads; t++ ) {
+        pool.start( new XMVentSweepTask( *net, model, scenario, result.data(), next,
+                                         meshCorrectionTolerance, iterationMax, lambda ) );
+    }
+    pool.waitForDone();
+    qCDebug( xmVentLog ) << "Sweep of" << scenario.count() << "scenarios on" << nThreads << "threads";
+
+    QVariantList r;
+    r.reserve( result.count() );
+    for( int i = 0; i < result.count(); i++ ) {
+        result[i].insert( "parameters", assignments[i] );
+        r.append( result[i] );
+    }
+
+    return r;
+}
@@ -0,0 +1,66 @@
+/*
+ *  Copyright (C) 2010 Andrew Wilson.
+ *  All rights reserved.
+ *  Contact email: amwgeo@gmail.com
+ *
+ *  This file is part of xmlMine-Vent
+ *
+ *  xmlMine-Vent is free software: you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation, either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  xmlMine-Vent is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General
+ *  Public License along with xmlMine-Vent.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef XMVENTSWEEP_H
+#define XMVENTSWEEP_H
+
+#include "xmvent-global.h"
+
+#include <QList>
+#include <QString>
+#include <QVariantList>
+#include <QVariantMap>
+#include <QVector>
+
+
+/// One parameter value of a sweep scenario.  In a script it is written as
+/// "fan:<fan id>", "resistance:<branch id>" or "flow:<fixed flow branch id>".
+struct XMVentSweepParameter {
+    enum Kind { FanPressure, Resistance, FixedFlow };
+
+    Kind kind;
+    int index;      // fan definition or branch index
+    float value;
+};
+
+typedef QVector<XMVentSweepParameter> XMVentSweepScenario;
+
+
+/// Solves many variations of one network concurrently.  With plain Hardy-Cross
+/// settings every thread solves an XMVentSolveHCScenario of one shared model,
+/// otherwise it works on its own copy of the network and solver.  Every
+/// scenario starts from the initial mesh flows, so the results do not depend
+/// on the number of threads.
+class XMVENTSHARED_EXPORT XMVentSweep
+{
+public:
+    static bool parse( const class XMVentNetwork* net, const QVariantMap& assignment,
+                       XMVentSweepScenario& scenario );
+    static QList<QVariantMap> grid( const QVariantMap& values );
+
+    static QVariantList run( class XMVentNetwork* net, const QList<QVariantMap>& assignments,
+                             float meshCorrectionTolerance, int iterationMax, float lambda, int threadCount );
+};
+
+
+#endif // XMVENTSWEEP_H
@@ -20,7 +20,7 @@
 #  <http://www.gnu.org/licenses/>.
 #
 
-QT += gui xml qml
+QT += gui qml
 
 TARGET = xmVent
 TEMPLATE = lib
@@ -29,6 +29,6 @@ DESTDIR = ../build
 
 DEFINES += XMVENT_LIBRARY
 
-SOURCES += branch.cpp fan.cpp junction.cpp network.cpp solvehc.cpp
+SOURCES += binary.cpp branch.cpp fan.cpp junction.cpp meshkernel.cpp network.cpp solvehc.cpp sparse.cpp statistics.cpp stringarena.cpp sweep.cpp
 
-HEADERS += xmvent-global.h branch.h fan.h junction.h network.h solvehc.h
+HEADERS += xmvent-global.h binary.h branch.h fan.h junction.h meshkernel.h network.h solvehc.h sparse.h statistics.h stringarena.h sweep.h
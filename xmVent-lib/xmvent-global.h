@@ -25,6 +25,7 @@
 #define XMVENT_GLOBAL_H
 
 #include <QtCore/qglobal.h>
+#include <QLoggingCategory>
 
 #if defined(XMVENT_LIBRARY)
 #  define XMVENTSHARED_EXPORT Q_DECL_EXPORT
@@ -32,4 +33,7 @@
 #  define XMVENTSHARED_EXPORT Q_DECL_IMPORT
 #endif
 
+/// progress of loading and solving, category "xmvent"; batch tools turn it off
+Q_DECLARE_LOGGING_CATEGORY( xmVentLog )
+
 #endif // XMVENT_GLOBAL_H
@@ -1,5 +1,5 @@
 TEMPLATE      = subdirs
 
-SUBDIRS = xmVent-lib xmVent
+SUBDIRS = xmVent-lib xmVent xmVent-bench xmVent-cli
 
 CONFIG += debug
@@ -49,16 +49,17 @@ int XMVentBranchModel::columnCount( const QModelIndex& /*parent*/ ) const
 QVariant XMVentBranchModel::data( const QModelIndex& index, int role ) const
 {
     if( index.isValid() && role == Qt::DisplayRole && index.row() < m_ventNet.m_branch.count() ) {
-        const XMVentBranch* branch = m_ventNet.m_branch[ index.row() ];
+        const XMVentBranchTable& branch = m_ventNet.m_branch;
+        const int b = index.row();
         switch( index.column() ) {
         case 0:
-            return branch->id();
+            return branch.id[b];
         case 1:
-            return m_ventNet.m_junction[ branch->fromId() ]->id();
+            return m_ventNet.m_junction.id[ branch.from[b] ];
         case 2:
-            return m_ventNet.m_junction[ branch->toId() ]->id();
+            return m_ventNet.m_junction.id[ branch.to[b] ];
         case 3:
-            return branch->resistance();
+            return branch.resistance[b];
         }
     }
 
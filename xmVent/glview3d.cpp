@@ -30,6 +30,7 @@
 #include <QPainter>
 #include <QOpenGLFramebufferObject>
 #include <QOpenGLPaintDevice>
+#include <QStandardPaths>
 
 #include "glcamera.h"
 #include "xmVent-lib/network.h"
@@ -50,6 +51,7 @@ XMGLView3D::XMGLView3D( QWidget *parent ):
     connect( m_camera, SIGNAL(changed()), this, SLOT(update()) );
 
     m_ventNet = new XMVentNetwork( this );
+    m_ventNet->m_solver.setMeshCache( QStandardPaths::writableLocation( QStandardPaths::CacheLocation ) + "/meshes" );
 //    XMVentNetwork::fromXml( "data/assignment2.xml", *mVentNet );
 
     grabGesture(Qt::PinchGesture);
@@ -103,7 +105,7 @@ void XMGLView3D::selectEvent(const QPoint &pos)
     int bestId = -1;
     float bestValue = qInf();
     for( int i=0; i<m_ventNet->m_junction.size(); i++ ) {
-        QVector3D u( m_ventNet->m_junction[i]->point() - ptNear );
+        QVector3D u( m_ventNet->m_junction.point[i] - ptNear );
         float dist = QVector3D::dotProduct(u, ray);
 
         // squared perpendicular distance to ray vector
@@ -128,8 +130,8 @@ void XMGLView3D::selectEvent(const QPoint &pos)
     if( bestId == -1 ) {
         qDebug() << "Did not click on a junction.";
     } else {
-        qDebug() << "Recentre view on Junction ID:" << m_ventNet->m_junction[bestId]->id();
-        QVector3D junction( m_ventNet->m_junction[bestId]->point() );
+        qDebug() << "Recentre view on Junction ID:" << m_ventNet->m_junction.id[bestId];
+        QVector3D junction( m_ventNet->m_junction.point[bestId] );
 
         // TODO: make an overload for QVector3D
         m_camera->setFocalPoint(junction.x(), junction.y(), junction.z() );
@@ -427,21 +429,11 @@ void XMGLView3D::glDrawNetworkModel(QVector<QVector3D> &vertexData)
 
     mShaderBasic.enableAttributeArray("vertex");
 
-    //TODO: figure out direct access to data stored in existing junction vector ...
-    //int stride = 0;
-    //if( m_ventNet->m_junction.size() > 1 ) {
-    //    //stride = &(m_ventNet->m_junction[1]->m_point) - &(m_ventNet->m_junction[0]->m_point);
-    //    stride = sizeof(XMVentJunction);
-    //}
-    //QVector3D *data2 = &(m_ventNet->m_junction[0]->m_point);
-    //QVector3D *data = (QVector3D*)(m_ventNet->m_junction.data() + offsetof(class XMVentJunction, m_point));
-    //mShaderBasic.setAttributeArray("vertex", data, stride);
-
     // copy out element data from branches
     QVector<GLuint> elements;
     for(int j=0; j<m_ventNet->m_branch.size(); j++) {
-        elements.append(m_ventNet->m_branch[j]->fromId());
-        elements.append(m_ventNet->m_branch[j]->toId());
+        elements.append(m_ventNet->m_branch.from[j]);
+        elements.append(m_ventNet->m_branch.to[j]);
     }
 
     // draw green lines
@@ -471,11 +463,8 @@ void XMGLView3D::paintGL()
     glDrawSelectShadowToFBO();
 
     // TODO: this only needs to be done when model data changes; setup signals
-    // copy out vertex data into convienient for purpose vector ...
-    QVector<QVector3D> vertexData;
-    for(int i=0; i< m_ventNet->m_junction.size(); i++ ) {
-        vertexData.append(m_ventNet->m_junction[i]->point());
-    }
+    // the junction points are adjacent already, no copy is made
+    QVector<QVector3D> vertexData( m_ventNet->m_junction.point );
     setupNodeVBO( m_vboNodes, vertexData);
 
     glDisable( GL_DEPTH_TEST );
@@ -537,10 +526,9 @@ void XMGLView3D::paintGL()
 
     // network node id
     for(int i=0; i< m_ventNet->m_junction.size(); i++ ) {
-        XMVentJunction *junction = m_ventNet->m_junction[i];
-        QVector3D p = matViewport * m_MVP * junction->point();
+        QVector3D p = matViewport * m_MVP * m_ventNet->m_junction.point[i];
         if(p.z() >= -1 && p.z() <= 1) {
-            painter.drawText( p.x(), p.y(), junction->id() );
+            painter.drawText( p.x(), p.y(), m_ventNet->m_junction.id[i] );
         }
     }
 
@@ -582,8 +570,8 @@ void XMGLView3D::open()
     qDebug() << "from,to,flow";
     for( int i = 0; i < m_ventNet->m_branch.count(); i++ ) {
         //qDebug() << "branch" << mVentNet->branch[i]->id() << "flow" << mVentNet->solver.flowList[i];
-        XMVentBranch* branch = m_ventNet->m_branch[i];
-        qDebug() << m_ventNet->m_junction[ branch->fromId() ]->id() << "," << m_ventNet->m_junction[ branch->toId() ]->id() << "," << m_ventNet->m_solver.m_flowList[i];
+        const XMVentBranchTable& branch = m_ventNet->m_branch;
+        qDebug() << m_ventNet->m_junction.id[ branch.from[i] ] << "," << m_ventNet->m_junction.id[ branch.to[i] ] << "," << m_ventNet->m_solver.m_flowList[i];
     }
 
     update();
@@ -614,7 +602,7 @@ void XMGLView3D::glDrawSelectShadowBuffer()
 
     mShaderNodeShadow.setUniformValue( "u_matMVP", m_MVP );
     mShaderNodeShadow.setUniformValue( "u_size", float(5.) );
-    mShaderNodeShadow.setUniformValue( "u_offset", m_ventNet->m_junction[0]->point() );
+    mShaderNodeShadow.setUniformValue( "u_offset", m_ventNet->m_junction.point[0] );
     mShaderNodeShadow.setUniformValue( "u_color", 1.f, 1.f, 1.f, 1.f );
     mShaderNodeShadow.enableAttributeArray( "a_vertex" );
     mShaderNodeShadow.setAttributeBuffer( "a_vertex", GL_FLOAT, 0, 3 );
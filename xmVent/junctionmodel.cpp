@@ -51,21 +51,22 @@ QVariant XMVentJunctionModel::data( const QModelIndex& index, int role ) const
     }
 
     if( index.isValid() && index.row() < m_ventNet.m_junction.count() ) {
-        const XMVentJunction* junction = m_ventNet.m_junction[ index.row() ];
+        const XMVentJunctionTable& junction = m_ventNet.m_junction;
+        const int j = index.row();
         switch( index.column() ) {
         case 0:
-            return junction->id();
+            return junction.id[j];
         case 1:
-            return float( junction->point().x() );
+            return float( junction.point[j].x() );
         case 2:
-            return float( junction->point().y() );
+            return float( junction.point[j].y() );
         case 3:
-            return float( junction->point().z() );
+            return float( junction.point[j].z() );
         case 4:
-            return junction->isSurface();
+            return junction.isSurface( j );
         case 5:
-            if( junction->referencePressure ) {
-               return junction->pressure;
+            if( junction.hasReferencePressure( j ) ) {
+               return junction.pressure[j];
             }
         }
     }
@@ -118,7 +119,8 @@ bool XMVentJunctionModel::setData( const QModelIndex &index,
                               const QVariant &value, int role )
 {
     if( index.isValid() && role == Qt::EditRole ) {
-        XMVentJunction* junction = m_ventNet.m_junction[ index.row() ];
+        XMVentJunctionTable& junction = m_ventNet.m_junction;
+        const int j = index.row();
 
         bool ok = false;
         float newValue;
@@ -126,22 +128,28 @@ bool XMVentJunctionModel::setData( const QModelIndex &index,
         switch( index.column() ) {
         case 0:
             // TODO: test for duplicate name ...
-            junction->setId( value.toString() );
+            junction.id.set( j, value.toString() );
             break;
         case 1:
             newValue = value.toFloat( &ok );
-            junction->point().setX( newValue );
+            if( ok ) {
+                junction.point[j].setX( newValue );
+            }
             break;
         case 2:
             newValue = value.toFloat( &ok );
-            junction->point().setY( newValue );
+            if( ok ) {
+                junction.point[j].setY( newValue );
+            }
             break;
         case 3:
             newValue = value.toFloat( &ok );
-            junction->point().setZ( newValue );
+            if( ok ) {
+                junction.point[j].setZ( newValue );
+            }
             break;
         case 4:
-            junction->setSurface( value.toBool() );
+            junction.setFlag( j, XMVentJunctionTable::Surface, value.toBool() );
             ok = true;
             break;
         }
@@ -162,8 +170,7 @@ bool XMVentJunctionModel::insertRow( int row, const QModelIndex & /*parent*/ )
         return false;
     }
 
-    XMVentJunction* junction = new XMVentJunction( &m_ventNet );
-    m_ventNet.m_junction.append( junction );
+    m_ventNet.m_junction.append( QStringRef(), QVector3D() );
     return true;
 }
 